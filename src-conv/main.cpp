@@ -18,17 +18,350 @@
 */
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <dirent.h>
 #include <string>
+#include <thread>
 #include <vector>
 #include <sys/stat.h>
 
 #include "vorbis/codec.h"
+#include "../src/chart.h"
+#include "../src/pack.h"
 
-int main()
+#define SAMPLE_RATE (44100 / 2)
+#define PREVIEW_LENGTH (SAMPLE_RATE * 15)
+#define PREVIEW_FADE (SAMPLE_RATE * 1)
+
+static void makePreview(std::string &pcmName, std::string &preName, int offset)
+{
+    // Attempt to load a converted PCM file
+    FILE *pcmFile = fopen(pcmName.c_str(), "rb");
+    if (!pcmFile) return;
+    fseek(pcmFile, 0, SEEK_END);
+    size_t samples = ftell(pcmFile) / (sizeof(int16_t) * 2);
+    fseek(pcmFile, 0, SEEK_SET);
+
+    // Mix the stereo samples down to mono
+    std::vector<int16_t> mono(samples);
+    for (size_t i = 0; i < samples;)
+    {
+        int16_t data[4096];
+        size_t count = fread(data, sizeof(int16_t), 4096, pcmFile) / 2;
+        if (count == 0) break;
+        for (size_t j = 0; j < count && i < samples; j++)
+            mono[i++] = (data[j * 2 + 0] + data[j * 2 + 1]) / 2;
+    }
+
+    fclose(pcmFile);
+    if (samples == 0) return;
+
+    size_t length = std::min<size_t>(samples, PREVIEW_LENGTH);
+    size_t start = 0;
+
+    if (offset >= 0)
+    {
+        // Start the preview at a fixed offset in seconds
+        start = std::min<size_t>((size_t)offset * SAMPLE_RATE, samples - length);
+    }
+    else
+    {
+        // Measure the energy of each quarter second of the song
+        size_t block = SAMPLE_RATE / 4;
+        std::vector<uint64_t> energy(samples / block);
+        for (size_t i = 0; i < energy.size() * block; i++)
+            energy[i / block] += (int32_t)mono[i] * mono[i];
+
+        // Start the preview at the loudest section, which is usually a chorus
+        size_t window = length / block;
+        uint64_t sum = 0, best = 0;
+        for (size_t i = 0; i < energy.size(); i++)
+        {
+            sum += energy[i];
+            if (i >= window) sum -= energy[i - window];
+            if (i + 1 >= window && sum > best)
+            {
+                best = sum;
+                start = (i + 1 - window) * block;
+            }
+        }
+    }
+
+    // Write the preview with a fade at the start and end
+    FILE *preFile = fopen(preName.c_str(), "wb");
+    if (!preFile) return;
+    for (size_t i = 0; i < length; i++)
+    {
+        int32_t sample = mono[start + i];
+        if (i < PREVIEW_FADE)
+            sample = sample * (int32_t)i / PREVIEW_FADE;
+        else if (length - i < PREVIEW_FADE)
+            sample = sample * (int32_t)(length - i) / PREVIEW_FADE;
+        int16_t value = sample;
+        fwrite(&value, sizeof(int16_t), 1, preFile);
+    }
+
+    fclose(preFile);
+}
+
+static size_t compileCharts()
+{
+    DIR *dir = opendir("dsc");
+    if (!dir) return 0;
+    std::vector<std::string> files;
+
+    // Build a list of all DSC files in the folder
+    while (dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name.length() > 4 && name.compare(name.length() - 4, 4, ".dsc") == 0)
+            files.push_back(name.substr(0, name.length() - 4));
+    }
+
+    closedir(dir);
+    sort(files.begin(), files.end());
+
+    // Create the destination folder if it doesn't exist
+#ifdef WINDOWS
+    mkdir("note");
+#else
+    mkdir("note", 0777);
+#endif
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        printf("Compiling chart %zu of %zu...\n", i + 1, files.size());
+
+        // Load the DSC file
+        FILE *dscFile = fopen(("dsc/" + files[i] + ".dsc").c_str(), "rb");
+        if (!dscFile) continue;
+        fseek(dscFile, 0, SEEK_END);
+        uint32_t size = ftell(dscFile);
+        fseek(dscFile, 0, SEEK_SET);
+        std::vector<uint32_t> dsc(size / 4);
+        dsc.resize(fread(dsc.data(), sizeof(uint32_t), dsc.size(), dscFile));
+        fclose(dscFile);
+
+        // Convert the opcodes to events, so the game doesn't have to
+        std::vector<ChartEvent> events;
+        if (!compileChart(dsc.data(), dsc.size(), events))
+        {
+            printf("Skipping %s, which isn't in a supported format.\n", files[i].c_str());
+            continue;
+        }
+
+        // Write the events after a header that ties them to the source file
+        FILE *noteFile = fopen(("note/" + files[i] + ".bin").c_str(), "wb");
+        if (!noteFile) continue;
+        ChartHeader header;
+        header.magic = CHART_MAGIC;
+        header.version = CHART_VERSION;
+        header.sourceSize = dsc.size() * 4;
+        header.sourceCrc = chartCrc(dsc.data(), dsc.size());
+        header.count = events.size();
+        fwrite(&header, sizeof(header), 1, noteFile);
+        fwrite(events.data(), sizeof(ChartEvent), events.size(), noteFile);
+        fclose(noteFile);
+    }
+
+    return files.size();
+}
+
+static void analyzeCharts()
+{
+    static const char *ends[] = { "_easy.dsc", "_normal.dsc", "_hard.dsc", "_extreme.dsc", "_extreme_1.dsc" };
+    std::vector<std::string> files;
+    std::vector<ChartMetrics> metrics;
+
+    // Build a list of charts named the way the game expects, with their song IDs and difficulties
+    if (DIR *dir = opendir("dsc"))
+    {
+        while (dirent *entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            size_t end = 3;
+            while (end < name.length() && name[end] >= '0' && name[end] <= '9')
+                end++;
+            if (name.compare(0, 3, "pv_") != 0 || end < 6 || end > 8)
+                continue;
+
+            for (int i = 0; i < 5; i++)
+            {
+                int id = atoi(name.substr(3, end - 3).c_str());
+                if (name.substr(end) != ends[i] || id > 0xFFFF)
+                    continue;
+                ChartMetrics entry = {};
+                entry.id = id;
+                entry.difficulty = i;
+                files.push_back("dsc/" + name);
+                metrics.push_back(entry);
+            }
+        }
+
+        closedir(dir);
+    }
+
+    printf("Analyzing %zu charts...\n", files.size());
+
+    // Measure the charts on every available thread, with each thread taking the next unclaimed chart
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < std::max(1U, std::thread::hardware_concurrency()); i++)
+    {
+        threads.emplace_back([&]()
+        {
+            for (size_t j; (j = next++) < files.size();)
+            {
+                FILE *dscFile = fopen(files[j].c_str(), "rb");
+                if (!dscFile) continue;
+                fseek(dscFile, 0, SEEK_END);
+                std::vector<uint32_t> dsc(ftell(dscFile) / 4);
+                fseek(dscFile, 0, SEEK_SET);
+                fread(dsc.data(), sizeof(uint32_t), dsc.size(), dscFile);
+                fclose(dscFile);
+
+                std::vector<ChartEvent> events;
+                compileChart(dsc.data(), dsc.size(), events);
+                measureChart(events, metrics[j]);
+            }
+        });
+    }
+
+    for (size_t i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    // Sort the entries so the game can look them up without building its own table
+    std::sort(metrics.begin(), metrics.end(), [](const ChartMetrics &a, const ChartMetrics &b)
+    {
+        return (a.difficulty != b.difficulty) ? (a.difficulty < b.difficulty) : (a.id < b.id);
+    });
+
+    // Write the metrics index
+    FILE *file = fopen("metrics.bin", "wb");
+    if (!file) return;
+    MetricsHeader header;
+    header.magic = METRICS_MAGIC;
+    header.version = METRICS_VERSION;
+    header.count = metrics.size();
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(metrics.data(), sizeof(ChartMetrics), metrics.size(), file);
+    fclose(file);
+}
+
+static void makePack()
 {
+    // Build a sorted list of the files the game reads from each folder
+    static const char *folders[][3] =
+    {
+        { "db",   ".txt", ""     },
+        { "dsc",  ".dsc", ""     },
+        { "note", ".bin", ""     },
+        { "pcm",  ".pcm", ".pre" },
+    };
+
+    std::vector<std::string> files;
+    for (int i = 0; i < 4; i++)
+    {
+        if (DIR *dir = opendir(folders[i][0]))
+        {
+            while (dirent *entry = readdir(dir))
+            {
+                std::string name = entry->d_name;
+                for (int j = 1; j < 3; j++)
+                {
+                    size_t length = strlen(folders[i][j]);
+                    if (length && name.length() > length && name.compare(name.length() - length, length, folders[i][j]) == 0)
+                        files.push_back((std::string)folders[i][0] + "/" + name);
+                }
+            }
+
+            closedir(dir);
+        }
+    }
+
+    sort(files.begin(), files.end());
+
+    // Build the name table
+    std::string names;
+    std::vector<PackEntry> entries(files.size());
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        entries[i].name = names.size();
+        names += files[i] + '\0';
+    }
+
+    // Lay out the file data after the table, with each file starting on a sector boundary
+    uint64_t offset = sizeof(PackHeader) + entries.size() * sizeof(PackEntry) + names.size();
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        struct stat st;
+        stat(files[i].c_str(), &st);
+        offset = (offset + PACK_ALIGN - 1) & ~(uint64_t)(PACK_ALIGN - 1);
+        entries[i].offset = offset;
+        entries[i].size = st.st_size;
+        offset += st.st_size;
+    }
+
+    // Make sure every offset in the pack can be reached with fseek, which takes a signed 32-bit long on the DS
+    if (offset > 0x7FFFFFFF)
+    {
+        printf("The pack would be larger than 2GB; leaving the files loose.\n");
+        return;
+    }
+
+    FILE *pakFile = fopen("data.pak", "wb");
+    if (!pakFile) return;
+
+    // Write the header and table
+    PackHeader header;
+    header.magic = PACK_MAGIC;
+    header.count = entries.size();
+    header.namesSize = names.size();
+    fwrite(&header, sizeof(header), 1, pakFile);
+    fwrite(entries.data(), sizeof(PackEntry), entries.size(), pakFile);
+    fwrite(names.data(), sizeof(char), names.size(), pakFile);
+
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        printf("Packing file %zu of %zu...\n", i + 1, files.size());
+
+        // Pad up to the file's offset and copy its data
+        static const char padding[PACK_ALIGN] = {};
+        fwrite(padding, sizeof(char), entries[i].offset - ftell(pakFile), pakFile);
+        if (FILE *file = fopen(files[i].c_str(), "rb"))
+        {
+            char data[0x10000];
+            while (size_t count = fread(data, sizeof(char), sizeof(data), file))
+                fwrite(data, sizeof(char), count, pakFile);
+            fclose(file);
+        }
+    }
+
+    fclose(pakFile);
+}
+
+int main(int argc, char **argv)
+{
+    int offset = -1;
+    bool pack = false;
+    bool analyze = false;
+
+    // Use a fixed preview offset in seconds if one is given, or find one automatically
+    // Measure the charts for the song list, and pack all the game files into a single archive afterwards if requested
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--pack"))
+            pack = true;
+        else if (!strcmp(argv[i], "--analyze"))
+            analyze = true;
+        else
+            offset = atoi(argv[i]);
+    }
+
     DIR *dir = opendir("ogg");
     std::vector<std::string> files;
     dirent *entry;
@@ -41,8 +374,13 @@ int main()
             files.push_back(name.substr(0, name.length() - 4));
     }
 
-    // Ensure there are files present
-    if (files.empty())
+    // Compile charts so the game can load them without interpreting DSC opcodes
+    size_t charts = compileCharts();
+    if (analyze)
+        analyzeCharts();
+
+    // Ensure there are files present, unless only compiling or analyzing charts or packing
+    if (files.empty() && !charts && !analyze && !pack)
     {
         printf("No OGG files found.\n");
         printf("Run this from the project-ds directory, with files in project-ds/ogg.\n");
@@ -51,7 +389,7 @@ int main()
         return 0;
     }
 
-    closedir(dir);
+    if (dir) closedir(dir);
     sort(files.begin(), files.end());
 
     // Create the destination folder if it doesn't exist
@@ -66,6 +404,7 @@ int main()
         // Infer names for all the files that might need to be accessed
         std::string oggName = "ogg/" + files[k] + ".ogg";
         std::string pcmName = "pcm/" + files[k] + ".pcm";
+        std::string preName = "pcm/" + files[k] + ".pre";
 
         // Attempt to load an OGG file for conversion
         if (FILE *oggFile = fopen(oggName.c_str(), "rb"))
@@ -160,8 +499,15 @@ int main()
             fclose(pcmFile);
             fclose(oggFile);
         }
+
+        // Cut a short preview clip for the song list
+        makePreview(pcmName, preName, offset);
     }
 
+    // Pack the converted files along with the charts and database
+    if (pack)
+        makePack();
+
     printf("Done!\n");
     printf("Press enter to close the program.\n");
     getc(stdin);
@@ -17,19 +17,237 @@
     along with Project DS. If not, see <https://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cstring>
+#include <unistd.h>
 #include <maxmod9.h>
 #include <nds.h>
 
 #include "vorbis/codec.h"
 
 #include "audio.h"
+#include "debug.h"
+#include "pack.h"
 
 static mm_stream stream;
+static mm_stream previewStream;
+static mm_stream metronomeStream;
 static FILE *song = nullptr;
 static int lagConfig = 0;
 static int songWait = 0;
 static int songOffset = 0;
+static bool streaming = false;
+static uint32_t songBase = 0;
+static uint32_t songSize = 0;
+static std::string primedName;
+static int32_t primedPos = 0;
+
+// Song data is streamed through a ring buffer that's refilled with bulk reads outside the stream callback
+#define RING_SIZE  0x10000
+#define RING_CHUNK 0x2000
+#define RING_ALIGN 0x200
+
+static uint8_t ring[RING_SIZE] ALIGN(32);
+static uint32_t ringRead = 0;
+static uint32_t ringWrite = 0;
+static uint32_t readPos = 0;
+static uint32_t playPos = 0;
+static bool ringLoop = false;
+
+// The metronome synthesizes a short decaying square wave click at the start of every beat
+#define CLICK_LENGTH 441
+#define CLICK_PERIOD 24
+
+static bool metronome = false;
+static uint32_t metronomePos = 0;
+static uint32_t metronomeBeat = 0;
+
+// Slowed down songs are time-stretched with WSOLA, overlap-adding segments that match the previous one's continuation
+#define STRETCH_HOP  256
+#define STRETCH_SEEK 64
+#define STRETCH_SIZE 2048
+
+static int songSpeed = 100;
+static int16_t stretchIn[STRETCH_SIZE * 2];
+static int16_t stretchOut[STRETCH_HOP * 2];
+static int32_t inCount = 0;
+static int32_t anaPos = 0;
+static int32_t anaFrac = 0;
+static int32_t tailPos = 0;
+static int32_t outLeft = 0;
+
+static FILE *oggFile = nullptr;
+static FILE *pcmFile = nullptr;
+static std::string pcmName;
+static uint32_t oggSize = 0;
+static uint32_t oggOffset = 0;
+static uint32_t checkOffset = 0;
+static uint32_t checkGranule = 0;
+static int convHeaders = 0;
+static bool convStarted = false;
+static bool convSkip = false;
+static bool convPage = false;
+static uint32_t pageStart = 0;
+static int64_t pageGranule = 0;
+
+static ogg_sync_state   oy;
+static ogg_stream_state os;
+static vorbis_info      vi;
+static vorbis_comment   vc;
+static vorbis_dsp_state vd;
+static vorbis_block     vb;
+
+static void seekSong(uint32_t pos)
+{
+    // Restart the ring buffer at a position in the song, reading from the start of the sector it's in
+    readPos = pos & ~(RING_ALIGN - 1);
+    playPos = pos;
+    ringWrite = 0;
+    ringRead = pos - readPos;
+    fseek(song, songBase + readPos, SEEK_SET);
+
+    // Reset the time-stretch state
+    inCount = anaPos = anaFrac = tailPos = outLeft = 0;
+}
+
+static void fillRing(int chunks)
+{
+    // Read chunks from the song into free space in the ring buffer
+    // The reads are large and sector-aligned so they go straight from the card into the buffer
+    for (int i = 0; i < chunks && (int32_t)(ringWrite - ringRead) + RING_CHUNK <= RING_SIZE; i++)
+    {
+        if (readPos == songSize)
+        {
+            // Stop at the end of the song, or go back to the start if looping
+            if (!ringLoop) return;
+            readPos = 0;
+            fseek(song, songBase, SEEK_SET);
+        }
+
+        // Don't read past the end of the song, which may be followed by other packed data, or past the end of the ring
+        uint32_t index = ringWrite % RING_SIZE;
+        uint32_t size = std::min(std::min<uint32_t>(RING_CHUNK, songSize - readPos), RING_SIZE - index);
+        size = fread(&ring[index], sizeof(uint8_t), size, song);
+        if (size == 0) return;
+        readPos += size;
+        ringWrite += size;
+    }
+}
+
+static void readRing(void *dest, size_t size)
+{
+    // Copy buffered samples to the stream, wrapping around the end of the ring
+    size_t count = std::min<int32_t>(size, std::max<int32_t>(0, ringWrite - ringRead));
+    uint32_t index = ringRead % RING_SIZE;
+    uint32_t first = std::min<uint32_t>(count, RING_SIZE - index);
+    memcpy(dest, &ring[index], first);
+    memcpy((uint8_t*)dest + first, ring, count - first);
+    ringRead += count;
+    playPos += count;
+
+    // Fill with silence if the buffer ran dry or the song ended
+    memset((uint8_t*)dest + count, 0, size - count);
+}
+
+static int32_t correlate(int32_t a, int32_t b)
+{
+    // Correlate two stretch input segments, using every 4th sample of the mono mix scaled down to avoid overflow
+    int32_t sum = 0;
+    for (int j = 0; j < STRETCH_HOP; j += 4)
+    {
+        int32_t x = (stretchIn[(a + j) * 2] + stretchIn[(a + j) * 2 + 1]) >> 5;
+        int32_t y = (stretchIn[(b + j) * 2] + stretchIn[(b + j) * 2 + 1]) >> 5;
+        sum += x * y;
+    }
+    return sum;
+}
+
+static void stretchStep()
+{
+    // Drop input that can no longer be used
+    int32_t drop = std::min(anaPos - STRETCH_SEEK, tailPos);
+    if (drop > 0)
+    {
+        memmove(stretchIn, &stretchIn[drop * 2], (inCount - drop) * 4);
+        inCount -= drop;
+        anaPos -= drop;
+        tailPos -= drop;
+    }
+
+    // Advance through the input by the output hop scaled by the song speed
+    anaFrac += STRETCH_HOP * songSpeed;
+    anaPos += anaFrac / 100;
+    anaFrac %= 100;
+
+    // Make sure there's enough input for the search and the crossfade
+    int32_t need = std::max(anaPos + STRETCH_SEEK, tailPos) + STRETCH_HOP;
+    if (need > inCount)
+    {
+        readRing(&stretchIn[inCount * 2], (need - inCount) * 4);
+        inCount = need;
+    }
+
+    // Search coarsely for the segment near the analysis position that best matches the last segment's continuation
+    int32_t first = std::max<int32_t>(0, anaPos - STRETCH_SEEK);
+    int32_t best = first, bestSum = INT32_MIN;
+    for (int32_t pos = first; pos <= anaPos + STRETCH_SEEK; pos += 4)
+    {
+        int32_t sum = correlate(pos, tailPos);
+        if (sum > bestSum)
+        {
+            best = pos;
+            bestSum = sum;
+        }
+    }
+
+    // Refine the search around the best coarse match
+    int32_t coarse = best;
+    for (int32_t pos = std::max(first, coarse - 3); pos <= std::min(anaPos + STRETCH_SEEK, coarse + 3); pos++)
+    {
+        int32_t sum = correlate(pos, tailPos);
+        if (sum > bestSum)
+        {
+            best = pos;
+            bestSum = sum;
+        }
+    }
+
+    // Crossfade from the last segment's continuation into the new segment
+    for (int j = 0; j < STRETCH_HOP; j++)
+    {
+        for (int c = 0; c < 2; c++)
+        {
+            int32_t a = stretchIn[(tailPos + j) * 2 + c] * (STRETCH_HOP - j);
+            int32_t b = stretchIn[(best + j) * 2 + c] * j;
+            stretchOut[j * 2 + c] = (a + b) / STRETCH_HOP;
+        }
+    }
+
+    tailPos = best + STRETCH_HOP;
+    outLeft = STRETCH_HOP;
+}
+
+static void readSong(void *dest, size_t size)
+{
+    // Copy samples straight from the ring buffer at full speed
+    if (songSpeed == 100)
+    {
+        readRing(dest, size);
+        return;
+    }
+
+    // Otherwise time-stretch them to keep the pitch the same
+    int16_t *out = (int16_t*)dest;
+    for (size_t count = size / 4; count > 0;)
+    {
+        if (!outLeft) stretchStep();
+        size_t n = std::min<size_t>(count, outLeft);
+        memcpy(out, &stretchOut[(STRETCH_HOP - outLeft) * 2], n * 4);
+        out += n * 2;
+        count -= n;
+        outLeft -= n;
+    }
+}
 
 static mm_word audioCallback(mm_word length, mm_addr dest, mm_stream_formats format)
 {
@@ -39,12 +257,32 @@ static mm_word audioCallback(mm_word length, mm_addr dest, mm_stream_formats for
         songWait -= length * 4;
         memset(dest, 0, length * 4);
         if (songWait >= 0) return length;
-        fread(dest + length * 4 + songWait, sizeof(int16_t), -songWait / 2, song);
+        readSong(dest + length * 4 + songWait, -songWait);
         return length;
     }
 
-    // Load more PCM samples from file
-    fread(dest, sizeof(int16_t), length * 2, song);
+    // Copy more PCM samples from the ring buffer
+    readSong(dest, length * 4);
+    return length;
+}
+
+static mm_word previewCallback(mm_word length, mm_addr dest, mm_stream_formats format)
+{
+    // Copy more mono PCM samples from the ring buffer, which loops back to the start of the clip
+    readRing(dest, length * 2);
+    return length;
+}
+
+static mm_word metronomeCallback(mm_word length, mm_addr dest, mm_stream_formats format)
+{
+    // Generate mono metronome samples, with silence between the clicks
+    int16_t *out = (int16_t*)dest;
+    for (mm_word i = 0; i < length; i++)
+    {
+        uint32_t t = metronomePos++ % metronomeBeat;
+        int32_t level = (t < CLICK_LENGTH) ? 12000 * (int32_t)(CLICK_LENGTH - t) / CLICK_LENGTH : 0;
+        out[i] = ((t / (CLICK_PERIOD / 2)) & 1) ? -level : level;
+    }
     return length;
 }
 
@@ -57,160 +295,430 @@ void audioInit()
     stream.format        = MM_STREAM_16BIT_STEREO;
     stream.timer         = MM_TIMER0;
     stream.manual        = true;
+
+    // Prepare the song preview stream, which is mono
+    previewStream = stream;
+    previewStream.callback = previewCallback;
+    previewStream.format   = MM_STREAM_16BIT_MONO;
+
+    // Prepare the metronome stream, which goes through the same path as songs so it has the same latency
+    metronomeStream = previewStream;
+    metronomeStream.callback = metronomeCallback;
+
+    // Account for the stream buffers, which are allocated statically
+    memoryTag(MEMORY_AUDIO, sizeof(ring) + sizeof(stretchIn) + sizeof(stretchOut));
 }
 
-void setLagConfig(int ms)
+static int lagOffset(int ms)
 {
     // Calculate a byte offset from a lag config in milliseconds
-    lagConfig = (44100 * 2 * ms / 1000) & ~0x3;
+    return (44100 * 2 * ms / 1000) & ~0x3;
+}
+
+void setLagConfig(int ms)
+{
+    lagConfig = lagOffset(ms);
+}
+
+void setSongSpeed(int percent)
+{
+    // Set the playback speed of songs, which is applied by time-stretching
+    songSpeed = percent;
 }
 
-void playSong(std::string &name)
+void playSong(std::string &name, uint32_t offset)
 {
+    // Start straight away if the song was primed at the same position
+    if (song && !streaming && name == primedName && (int32_t)(offset - lagConfig) == primedPos)
+    {
+        primedName.clear();
+        mmStreamOpen(&stream);
+        streaming = true;
+        return;
+    }
+
     // Reset the PCM stream
-    if (song) fclose(song);
+    closeSong();
     songOffset = 0;
 
-    // Open and play a PCM file if it exists, skipping ahead if early
-    if ((song = fopen(name.c_str(), "rb")))
+    // Open and play a PCM file if it exists from a byte offset, delaying or skipping ahead based on lag
+    if ((song = openFile(name, songBase, songSize)))
     {
-        if ((songWait = lagConfig) < 0)
-            fseek(song, -lagConfig, SEEK_SET);
+        int32_t pos = offset - lagConfig;
+        songWait = (pos < 0) ? -pos : 0;
+        ringLoop = false;
+        seekSong((pos < 0) ? 0 : pos);
+        fillRing(RING_SIZE / RING_CHUNK);
         mmStreamOpen(&stream);
+        streaming = true;
+    }
+}
+
+void primeSong(std::string &name, int lagMs)
+{
+    // Open a song and fill its buffer from the start ahead of time, so playing it doesn't have to wait for the card
+    // The song's lag is given separately, since it only gets applied once the song is actually played
+    closeSong();
+    songOffset = 0;
+    if ((song = openFile(name, songBase, songSize)))
+    {
+        primedPos = -lagOffset(lagMs);
+        songWait = (primedPos < 0) ? -primedPos : 0;
+        ringLoop = false;
+        seekSong((primedPos < 0) ? 0 : primedPos);
+        fillRing(RING_SIZE / RING_CHUNK);
+        primedName = name;
+    }
+}
+
+void cueSong(std::string &name, uint32_t offset)
+{
+    // Open a PCM file without playing it, so it can be resumed from a byte offset
+    closeSong();
+    if ((song = openFile(name, songBase, songSize)))
+    {
+        int32_t pos = offset - lagConfig;
+        songWait = (pos < 0) ? -pos : 0;
+        songOffset = (pos < 0) ? 0 : pos;
+        ringLoop = false;
     }
 }
 
+bool playPreview(std::string &name)
+{
+    // Reset the PCM stream
+    closeSong();
+    songOffset = 0;
+    songWait = 0;
+
+    // Open and play a preview clip if it exists
+    if ((song = openFile(name, songBase, songSize)))
+    {
+        ringLoop = true;
+        seekSong(0);
+        fillRing(RING_SIZE / RING_CHUNK);
+        mmStreamOpen(&previewStream);
+        streaming = true;
+        return true;
+    }
+
+    return false;
+}
+
 void resumeSong()
 {
     // Resume the PCM stream if it's loaded
     if (song)
     {
-        fseek(song, songOffset, SEEK_SET);
+        seekSong(songOffset);
+        fillRing(RING_SIZE / RING_CHUNK);
         mmStreamOpen(&stream);
+        streaming = true;
     }
 }
 
 void updateSong()
 {
-    // Update the PCM stream if it's loaded
-    if (song)
+    // Top up the ring buffer and update the PCM stream if it's playing
+    if (streaming)
+    {
+        fillRing(1);
+        mmStreamUpdate();
+    }
+    else if (metronome)
+    {
         mmStreamUpdate();
+    }
+}
+
+void playMetronome(uint32_t bpm)
+{
+    // Start a metronome on the stream in place of any song, with the first click at the start
+    stopSong();
+    metronomePos = 0;
+    metronomeBeat = 44100 / 2 * 60 / bpm;
+    mmStreamOpen(&metronomeStream);
+    metronome = true;
+}
+
+void stopMetronome()
+{
+    // Stop the metronome if it's playing
+    if (metronome)
+    {
+        mmStreamClose();
+        metronome = false;
+    }
 }
 
 void stopSong()
 {
-    // Stop the PCM stream if it's loaded
-    if (song)
+    // Stop the PCM stream if it's playing
+    if (streaming)
     {
         mmStreamClose();
-        songOffset = ftell(song);
+        streaming = false;
+        songOffset = playPos;
+
+        // Don't skip the input that was buffered for time-stretching but not played yet
+        if (songSpeed != 100)
+            songOffset = std::max<int32_t>(0, songOffset - (inCount - anaPos) * 4) & ~0x3;
     }
 }
 
-bool convertSong(std::string &src, std::string &dst)
+void closeSong()
+{
+    // Stop the PCM stream if it's playing and close its file
+    primedName.clear();
+    if (song)
+    {
+        if (streaming) mmStreamClose();
+        streaming = false;
+        fclose(song);
+        song = nullptr;
+    }
+}
+
+static std::string swapExtension(std::string &name, const char *ext)
+{
+    // Replace the extension at the end of a filename
+    return name.substr(0, name.rfind('.')) + ext;
+}
+
+static void convertClose()
+{
+    // Free the decoder state and close the files of the current conversion job
+    if (convHeaders == 3)
+    {
+        vorbis_block_clear(&vb);
+        vorbis_dsp_clear(&vd);
+    }
+    if (convStarted)
+        ogg_stream_clear(&os);
+    vorbis_comment_clear(&vc);
+    vorbis_info_clear(&vi);
+    ogg_sync_clear(&oy);
+
+    fclose(oggFile);
+    fclose(pcmFile);
+    oggFile = nullptr;
+    pcmFile = nullptr;
+}
+
+bool convertStart(std::string &src, std::string &dst)
 {
     // Attempt to load an OGG file for conversion
-    if (FILE *oggFile = fopen(src.c_str(), "rb"))
-    {
-        ogg_sync_state   oy;
-        ogg_stream_state os;
-        ogg_page         og;
-        ogg_packet       op;
-
-        vorbis_info      vi;
-        vorbis_comment   vc;
-        vorbis_dsp_state vd;
-        vorbis_block     vb;
-
-        // Get the file size for progress tracking
-        fseek(oggFile, 0, SEEK_END);
-        size_t oggSize = ftell(oggFile);
-        fseek(oggFile, 0, SEEK_SET);
-
-        // Read the first block from the OGG file
-        ogg_sync_init(&oy);
-        char *buffer = ogg_sync_buffer(&oy, 4096);
-        size_t bytes = fread(buffer, sizeof(uint8_t), 4096, oggFile);
-        ogg_sync_wrote(&oy, bytes);
-
-        // Initialize the stream and get the first page
-        ogg_sync_pageout(&oy, &og);
-        ogg_stream_init(&os, ogg_page_serialno(&og));
-        ogg_stream_pagein(&os, &og);
-        ogg_stream_packetout(&os, &op);
+    if (oggFile) convertPause();
+    if (!(oggFile = fopen(src.c_str(), "rb")))
+        return false;
+
+    // Get the file size for progress tracking
+    fseek(oggFile, 0, SEEK_END);
+    oggSize = ftell(oggFile);
+    fseek(oggFile, 0, SEEK_SET);
+
+    // Decode to a partial file that's only renamed once complete
+    pcmName = dst;
+    std::string partName = swapExtension(dst, ".part");
+    checkOffset = checkGranule = 0;
+
+    // Load a checkpoint if the song was partially converted before
+    if (FILE *progFile = fopen(swapExtension(dst, ".prog").c_str(), "rb"))
+    {
+        uint32_t check[2];
+        if (fread(check, sizeof(uint32_t), 2, progFile) == 2 && (pcmFile = fopen(partName.c_str(), "r+b")))
+        {
+            // Discard anything written after the checkpoint so decoding can continue from it
+            checkOffset = check[0];
+            checkGranule = check[1];
+            ftruncate(fileno(pcmFile), (checkGranule >> 1) * 4);
+            fseek(pcmFile, 0, SEEK_END);
+        }
 
-        // Initialize the decoder with the initial header
-        vorbis_info_init(&vi);
-        vorbis_comment_init(&vc);
-        vorbis_synthesis_headerin(&vi, &vc, &op);
-        vorbis_synthesis_halfrate(&vi, 1);
+        fclose(progFile);
+    }
+
+    // Start a new file if there was nothing to resume
+    if (!pcmFile && !(pcmFile = fopen(partName.c_str(), "wb")))
+    {
+        fclose(oggFile);
+        oggFile = nullptr;
+        return false;
+    }
+
+    // Prepare the decoder, which is initialized further as headers are read
+    ogg_sync_init(&oy);
+    vorbis_info_init(&vi);
+    vorbis_comment_init(&vc);
+    convHeaders = 0;
+    convStarted = false;
+    convSkip = false;
+    convPage = false;
+    oggOffset = 0;
+    return true;
+}
 
-        printf("Converting to PCM16...\n");
+int convertStep()
+{
+    // Decode a single packet of the current conversion job, so each step stays short
+    if (!oggFile) return -1;
+    ogg_packet op;
 
-        int i = 0;
-        FILE *pcmFile = fopen(dst.c_str(), "wb");
+    if (!convPage)
+    {
+        ogg_page og;
+        long bytes;
 
-        // Decode until the end of the file is reached
-        while (true)
+        // Read more blocks from the OGG file until a page is found, skipping any invalid data
+        while ((bytes = ogg_sync_pageseek(&oy, &og)) <= 0)
         {
-            // Read more blocks from the OGG file and track progress
-            if (!ogg_sync_pageout(&oy, &og))
+            if (bytes < 0)
             {
-                buffer = ogg_sync_buffer(&oy, 4096);
-                bytes = fread(buffer, sizeof(uint8_t), 4096, oggFile);
-                if (bytes == 0) break;
-                ogg_sync_wrote(&oy, bytes);
-                printf("\x1b[1;0H%ld%%\n", ftell(oggFile) * 100 / oggSize);
+                oggOffset -= bytes;
                 continue;
             }
 
-            // Get another page
-            ogg_stream_pagein(&os, &og);
-
-            while (ogg_stream_packetout(&os, &op))
+            char *buffer = ogg_sync_buffer(&oy, 4096);
+            size_t size = fread(buffer, sizeof(uint8_t), 4096, oggFile);
+            ogg_sync_wrote(&oy, size);
+            if (size > 0) continue;
+
+            // Finish the job at the end of the file, keeping the output only if the headers were valid
+            bool valid = (convHeaders == 3);
+            std::string partName = swapExtension(pcmName, ".part");
+            convertClose();
+            remove(swapExtension(pcmName, ".prog").c_str());
+            if (valid)
             {
-                // Get the comment and codebook headers and finish initializing the decoder
-                if (i < 2)
-                {
-                    vorbis_synthesis_headerin(&vi, &vc, &op);
-                    if (++i < 2) continue;
-                    vorbis_synthesis_init(&vd, &vi);
-                    vorbis_block_init(&vd, &vb);
-                    break;
-                }
+                remove(pcmName.c_str());
+                rename(partName.c_str(), pcmName.c_str());
+                return 100;
+            }
+
+            remove(partName.c_str());
+            return -1;
+        }
+
+        pageStart = oggOffset;
+        pageGranule = ogg_page_granulepos(&og);
+        oggOffset += bytes;
+
+        // Initialize the stream with the first page
+        if (!convStarted)
+        {
+            ogg_stream_init(&os, ogg_page_serialno(&og));
+            convStarted = true;
+        }
+
+        // Queue the page's packets, which are decoded over the following steps
+        ogg_stream_pagein(&os, &og);
+        convPage = true;
+    }
+
+    if (ogg_stream_packetout(&os, &op) <= 0)
+    {
+        // Remember the last page that completed a packet, since all output up to its granule position has been written
+        // Resuming from it means the output continues seamlessly once the decoder has been primed with it again
+        convPage = false;
+        if (convHeaders == 3 && pageGranule > 0)
+        {
+            convSkip = false;
+            checkOffset = pageStart;
+            checkGranule = pageGranule;
+        }
+
+        return oggOffset * 99LL / oggSize;
+    }
+
+    // Get the identification, comment, and codebook headers and initialize the decoder
+    if (convHeaders < 3)
+    {
+        vorbis_synthesis_headerin(&vi, &vc, &op);
+        if (++convHeaders == 1)
+            vorbis_synthesis_halfrate(&vi, 1);
+        if (convHeaders < 3)
+            return oggOffset * 99LL / oggSize;
+        vorbis_synthesis_init(&vd, &vi);
+        vorbis_block_init(&vd, &vb);
+
+        // Jump to the checkpoint page if resuming, which is decoded again without output to prime the decoder
+        if (checkOffset)
+        {
+            ogg_sync_reset(&oy);
+            ogg_stream_reset(&os);
+            fseek(oggFile, checkOffset, SEEK_SET);
+            oggOffset = checkOffset;
+            convSkip = true;
+            convPage = false;
+        }
+
+        return oggOffset * 99LL / oggSize;
+    }
 
-                // Decode a packet
-                vorbis_synthesis(&vb, &op);
-                vorbis_synthesis_blockin(&vd, &vb);
+    // Decode a packet
+    vorbis_synthesis(&vb, &op);
+    vorbis_synthesis_blockin(&vd, &vb);
 
-                float **pcm;
+    float **pcm;
 
-                while (int samples = vorbis_synthesis_pcmout(&vd, &pcm))
+    while (int samples = vorbis_synthesis_pcmout(&vd, &pcm))
+    {
+        // Convert floats and combine channels to produce stereo PCM16
+        if (!convSkip)
+        {
+            int16_t conv[2048] = {};
+            for (int j = 0; j < samples; j++)
+            {
+                for (int c = 0; c < std::min(4, vi.channels); c += 2)
                 {
-                    // Convert floats and combine channels to produce stereo PCM16
-                    int16_t conv[2048] = {};
-                    for (int j = 0; j < samples; j++)
-                    {
-                        for (int c = 0; c < std::min(4, vi.channels); c += 2)
-                        {
-                            conv[j * 2 + 0] += pcm[c + 0][j] * 32767.0f;
-                            conv[j * 2 + 1] += pcm[c + 1][j] * 32767.0f;
-                        }
-                    }
-
-                    // Write the converted data to file
-                    fwrite(conv, sizeof(int16_t), samples * 2, pcmFile);
-                    vorbis_synthesis_read(&vd, samples);
+                    conv[j * 2 + 0] += pcm[c + 0][j] * 32767.0f;
+                    conv[j * 2 + 1] += pcm[c + 1][j] * 32767.0f;
                 }
             }
+
+            // Write the converted data to file
+            fwrite(conv, sizeof(int16_t), samples * 2, pcmFile);
         }
 
-        fclose(pcmFile);
-        fclose(oggFile);
+        vorbis_synthesis_read(&vd, samples);
+    }
 
-        printf("Done!\n");
-        return true;
+    return oggOffset * 99LL / oggSize;
+}
+
+void convertPause()
+{
+    // Stop the current conversion job, saving a checkpoint so it can be resumed later
+    if (!oggFile) return;
+    uint32_t check[2] = { checkOffset, checkGranule };
+    std::string progName = swapExtension(pcmName, ".prog");
+    convertClose();
+
+    if (check[0])
+    {
+        if (FILE *progFile = fopen(progName.c_str(), "wb"))
+        {
+            fwrite(check, sizeof(uint32_t), 2, progFile);
+            fclose(progFile);
+        }
     }
+}
 
-    return false;
+bool convertSong(std::string &src, std::string &dst)
+{
+    // Run a conversion job until it's done, resuming it if it was started in the background
+    if (!convertStart(src, dst))
+        return false;
+
+    printf("Converting to PCM16...\n");
+
+    int progress, shown = -1;
+    while ((progress = convertStep()) >= 0 && progress < 100)
+    {
+        if (progress != shown)
+            printf("\x1b[1;0H%d%%\n", shown = progress);
+    }
+
+    printf("Done!\n");
+    return (progress == 100);
 }
@@ -20,16 +20,28 @@
 #ifndef AUDIO_H
 #define AUDIO_H
 
+#include <cstdint>
 #include <string>
 
 extern void audioInit();
 extern void setLagConfig(int ms);
+extern void setSongSpeed(int percent);
 
-extern void playSong(std::string &name);
+extern void playSong(std::string &name, uint32_t offset = 0);
+extern void primeSong(std::string &name, int lagMs);
+extern void cueSong(std::string &name, uint32_t offset);
+extern bool playPreview(std::string &name);
 extern void resumeSong();
 extern void updateSong();
 extern void stopSong();
+extern void closeSong();
 
+extern void playMetronome(uint32_t bpm);
+extern void stopMetronome();
+
+extern bool convertStart(std::string &src, std::string &dst);
+extern int convertStep();
+extern void convertPause();
 extern bool convertSong(std::string &src, std::string &dst);
 
 #endif // AUDIO_H
@@ -0,0 +1,373 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CHART_H
+#define CHART_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#define CHART_MAGIC 0x544E4450 // "PDNT"
+#define CHART_VERSION 2
+
+#define METRICS_MAGIC 0x584D4450 // "PDMX"
+#define METRICS_VERSION 1
+
+#define CHART_PI 3.14159
+#define CHART_CIRCLE (1 << 15) // DEGREES_IN_CIRCLE in libnds
+
+enum EventType
+{
+    EVENT_END,
+    EVENT_TIME,
+    EVENT_NOTE,
+    EVENT_LYRIC,
+    EVENT_MUSIC,
+    EVENT_FLYTIME,
+    EVENT_EFFECT
+};
+
+// Header at the start of a compiled chart, followed by its events
+struct ChartHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sourceSize;
+    uint32_t sourceCrc;
+    uint32_t count;
+};
+
+// A chart opcode that matters to the game, with note positions and full-speed increments already in screen space
+struct ChartEvent
+{
+    uint32_t value; // Time, lyric index, or flying time
+    uint8_t event;
+    uint8_t type;
+    int16_t x, y;
+    uint16_t incArrow;
+    int32_t ofsX, ofsY;
+    int32_t incX, incY;
+};
+
+// Header at the start of the metrics index, followed by its entries
+struct MetricsHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+};
+
+// Objective measurements of a chart, sorted by difficulty and then song ID in the index
+struct ChartMetrics
+{
+    uint16_t id;
+    uint16_t difficulty;
+    uint16_t notes;
+    uint16_t peakDensity; // Most notes hit within one second
+    uint16_t holds;
+    uint16_t slides;
+    uint32_t minFlyTime;
+    uint32_t maxFlyTime;
+};
+
+enum ChartFormat
+{
+    FORMAT_UNKNOWN = 0,
+    FORMAT_FT,   // Future Tone and Mega Mix, which share opcodes
+    FORMAT_PVSC, // F 2nd and X, which wrap their scripts in a PVSC container
+    FORMAT_BE    // PS3 releases, which store words big-endian
+};
+
+// Opcode numbers and parameter counts for Future Tone charts
+struct FutureTone
+{
+    enum Opcode
+    {
+        END = 0x00,
+        TIME = 0x01,
+        TARGET = 0x06,
+        LYRIC = 0x18,
+        MUSIC_PLAY = 0x19,
+        BAR_TIME_SET = 0x1C,
+        TARGET_FLYING_TIME = 0x3A,
+        SE_EFFECT = 0x49,
+        PSE = 0x6A
+    };
+
+    static uint8_t params(uint32_t opcode)
+    {
+        static const uint8_t counts[0x100] =
+        {
+            0,  1,  4,  2,  2,  2,  7,  4,  2,  6,  2,  1,  6,  2,  1,  1, // 0x00-0x0F
+            3,  2,  3,  5,  5,  4,  4,  5,  2,  0,  2,  4,  2,  2,  1, 21, // 0x10-0x1F
+            0,  3,  2,  5,  1,  1,  7,  1,  1,  2,  1,  2,  1,  2,  3,  3, // 0x20-0x2F
+            1,  2,  2,  3,  6,  6,  1,  1,  2,  3,  1,  2,  2,  4,  4,  1, // 0x30-0x3F
+            2,  1,  2,  1,  1,  3,  3,  3,  2,  1,  9,  3,  2,  4,  2,  3, // 0x40-0x4F
+            2, 24,  1,  2,  1,  3,  1,  3,  4,  1,  2,  6,  3,  2,  3,  3, // 0x50-0x5F
+            4,  1,  1,  3,  3,  4,  2,  3,  3,  8,  2                      // 0x60-0x6A
+        };
+
+        return counts[opcode & 0xFF];
+    }
+};
+
+inline uint16_t chartCrc(const uint32_t *chart, size_t size)
+{
+    // Calculate a CRC-16 of a chart's words, so an edited chart can be told apart from one of the same size
+    uint16_t crc = 0xFFFF;
+    const uint8_t *bytes = (const uint8_t*)chart;
+    for (size_t i = 0; i < size * 4; i++)
+    {
+        crc ^= bytes[i];
+        for (int j = 0; j < 8; j++)
+            crc = (crc & 1) ? ((crc >> 1) ^ 0xA001) : (crc >> 1);
+    }
+    return crc;
+}
+
+inline uint32_t barFlyTime(uint32_t bpm, uint32_t beats)
+{
+    // Calculate the flying time using beats per minute and beats per bar
+    return (60.0f / bpm) * (beats + 1) * 100000;
+}
+
+inline ChartFormat detectChart(const uint32_t *chart, size_t size)
+{
+    // Identify a chart from its first words, only ruling out Future Tone for formats that are positively recognised
+    // The first word is usually a date signature, but anything else is still read as Future Tone like before
+    if (size < 2)
+        return FORMAT_UNKNOWN;
+    if (chart[0] == 0x43535650) // "PVSC"
+        return FORMAT_PVSC;
+    if (chart[1] && !(chart[1] & 0x00FFFFFF)) // A byte-swapped first opcode
+        return FORMAT_BE;
+    return FORMAT_FT;
+}
+
+template <typename Format>
+void compileChart(const uint32_t *chart, size_t size, std::vector<ChartEvent> &events)
+{
+    ChartEvent note = {};
+    uint32_t flyTime = 100000;
+    events.clear();
+
+    // Convert DSC opcodes to events, skipping the signature and anything the game doesn't use
+    for (size_t count = 1; count < size; count += Format::params(chart[count]) + 1)
+    {
+        // Stop if an opcode's parameters would run past the end of the file
+        if (count + Format::params(chart[count]) >= size)
+            break;
+
+        ChartEvent event = {};
+        switch (chart[count])
+        {
+            case Format::END: // End
+                break;
+
+            case Format::TIME: // Time
+                event.event = EVENT_TIME;
+                event.value = chart[count + 1];
+                events.push_back(event);
+                continue;
+
+            case Format::TARGET: // Target
+            {
+                int16_t x = chart[count + 2] * 256 / 480000 - 16;
+                int16_t y = chart[count + 3] * 192 / 270000 - 16;
+
+                // Set the note type
+                uint8_t type;
+                if (chart[count + 1] < 4) // Normal buttons
+                {
+                    type = chart[count + 1];
+                }
+                else if (chart[count + 1] < 8) // Held buttons
+                {
+                    // Mark held buttons with bit 4
+                    type = (chart[count + 1] & 3) | (1 << 4);
+                }
+                else if (chart[count + 1] == 12 || chart[count + 1] == 13) // Single slides
+                {
+                    // Mark single slides with bit 5
+                    type = (chart[count + 1] - 8) | (1 << 5);
+                }
+                else if (chart[count + 1] == 15) // Left held slide
+                {
+                    // Mark all held slides with bit 6, and non-initial ones with bit 7
+                    type = 4 | (1 << 6);
+                    if (type == (note.type & ~(1 << 7)) && x < note.x && y == note.y)
+                        type |= (1 << 7);
+                }
+                else if (chart[count + 1] == 16) // Right held slide
+                {
+                    // Mark all held slides with bit 6, and non-initial ones with bit 7
+                    type = 5 | (1 << 6);
+                    if (type == (note.type & ~(1 << 7)) && x > note.x && y == note.y)
+                        type |= (1 << 7);
+                }
+                else if (chart[count + 1] >= 18 && chart[count + 1] < 22) // Event notes
+                {
+                    // These normally trigger PV events; treat them as regular notes for now
+                    type = chart[count + 1] - 18;
+                }
+                else
+                {
+                    continue;
+                }
+
+                // Get the note angle and travel distance, scaled
+                float angle = (float)(int32_t)chart[count + 4] * CHART_PI / 180000;
+                float distance = (float)chart[count + 5] * 0x100 / 270000;
+
+                // Calculate the positional offset and per-frame increment at full speed
+                note.event = EVENT_NOTE;
+                note.type = type;
+                note.x = x;
+                note.y = y;
+                note.value = flyTime;
+                note.incX = (int)(sin(angle) *  distance);
+                note.incY = (int)(cos(angle) * -distance);
+                note.ofsX = note.incX * 60 * 3;
+                note.ofsY = note.incY * 60 * 3;
+                note.incX *= 100000.0f * 3 / flyTime;
+                note.incY *= 100000.0f * 3 / flyTime;
+                note.incArrow = ((float)CHART_CIRCLE / 60) * 100000 / flyTime;
+                events.push_back(note);
+                continue;
+            }
+
+            case Format::LYRIC: // Lyric
+                event.event = EVENT_LYRIC;
+                event.value = chart[count + 1];
+                events.push_back(event);
+                continue;
+
+            case Format::MUSIC_PLAY: // Music play
+                event.event = EVENT_MUSIC;
+                events.push_back(event);
+                continue;
+
+            case Format::BAR_TIME_SET: // Bar time set
+                flyTime = barFlyTime(chart[count + 1], chart[count + 2]);
+                event.event = EVENT_FLYTIME;
+                event.value = flyTime;
+                events.push_back(event);
+                continue;
+
+            case Format::TARGET_FLYING_TIME: // Target flying time
+                flyTime = chart[count + 1] * 100;
+                event.event = EVENT_FLYTIME;
+                event.value = flyTime;
+                events.push_back(event);
+                continue;
+
+            case Format::SE_EFFECT: // Sound effect
+            case Format::PSE: // PSE
+                event.event = EVENT_EFFECT;
+                events.push_back(event);
+                continue;
+
+            default:
+                continue;
+        }
+
+        break;
+    }
+
+    // Always finish with an end event
+    ChartEvent end = {};
+    end.event = EVENT_END;
+    events.push_back(end);
+}
+
+inline bool compileChart(const uint32_t *chart, size_t size, std::vector<ChartEvent> &events)
+{
+    // Compile a chart with the opcode table for its format, so the opcode loop doesn't have to check it
+    // Only Future Tone opcodes are known for now, so other formats are rejected rather than misread
+    switch (detectChart(chart, size))
+    {
+        case FORMAT_FT:
+            compileChart<FutureTone>(chart, size, events);
+            return true;
+
+        default:
+            events.clear();
+            return false;
+    }
+}
+
+inline void measureChart(const std::vector<ChartEvent> &events, ChartMetrics &metrics)
+{
+    std::vector<uint32_t> times;
+    uint32_t time = 0;
+    uint32_t flyTime = 100000;
+    bool multi = false;
+    metrics.notes = metrics.peakDensity = metrics.holds = metrics.slides = 0;
+    metrics.minFlyTime = metrics.maxFlyTime = 0;
+
+    // Walk the events the same way the game counts combo-able notes, recording when each is hit
+    for (size_t i = 0; i < events.size(); i++)
+    {
+        const ChartEvent &event = events[i];
+        if (event.event == EVENT_TIME)
+        {
+            time = event.value;
+            multi = false;
+        }
+        else if (event.event == EVENT_FLYTIME)
+        {
+            flyTime = event.value;
+        }
+        else if (event.event == EVENT_NOTE)
+        {
+            // Count held buttons and slides, treating each held slide chain as one slide
+            if (event.type & (1 << 4))
+                metrics.holds++;
+            else if ((event.type & (1 << 5)) || (event.type & 0xC0) == (1 << 6))
+                metrics.slides++;
+
+            // Track the range of flying times that notes actually use
+            if (!metrics.minFlyTime || flyTime < metrics.minFlyTime)
+                metrics.minFlyTime = flyTime;
+            if (flyTime > metrics.maxFlyTime)
+                metrics.maxFlyTime = flyTime;
+
+            if (!multi && !(event.type & (1 << 7)))
+                times.push_back(time + flyTime);
+            multi = true;
+        }
+    }
+
+    // Find the most notes hit within any one-second window
+    std::sort(times.begin(), times.end());
+    for (size_t i = 0, j = 0; i < times.size(); i++)
+    {
+        while (times[i] - times[j] >= 100000)
+            j++;
+        if (i - j + 1 > metrics.peakDensity)
+            metrics.peakDensity = i - j + 1;
+    }
+
+    metrics.notes = std::min<size_t>(times.size(), 0xFFFF);
+}
+
+#endif // CHART_H
@@ -18,11 +18,18 @@
 */
 
 #include <algorithm>
+#include <cstring>
 #include <dirent.h>
+#include <map>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
 
 #include <nds.h>
 
 #include "database.h"
+#include "debug.h"
+#include "pack.h"
 
 static const std::string diffs[] =
 {
@@ -33,7 +40,52 @@ static const std::string diffs[] =
     "extreme.1."
 };
 
-SongData songData[1000];
+#define CACHE_MAGIC 0x43534450 // "PDSC"
+#define CACHE_VERSION 2
+
+struct CacheHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t fileCount;
+    uint32_t songCount;
+    uint32_t dataSize;
+    uint32_t lyricsSize;
+};
+
+struct CacheStamp
+{
+    uint32_t hash;
+    uint32_t size;
+    uint32_t mtime;
+};
+
+struct CacheSong
+{
+    uint16_t id;
+    uint16_t lyricCount;
+    uint32_t difficulty;
+    uint32_t name;
+    uint32_t lyrics;
+    uint32_t lyricsSize;
+};
+
+struct ScoreRecord
+{
+    uint16_t id;
+    uint8_t difficulty;
+    uint8_t rank;
+    uint32_t score;
+    float clear;
+    uint16_t reserved;
+    uint16_t crc;
+};
+
+std::vector<SongData> songData;
+static std::string songNames(1, '\0');
+
+static char *lyricArena = nullptr;
+static size_t lyricCount = 0;
 
 static void formatString(std::string &string)
 {
@@ -54,132 +106,494 @@ static void formatString(std::string &string)
     string.erase(string.end() - 1);
 }
 
+static uint32_t hashName(const char *name)
+{
+    // Hash a filename with FNV-1a so it can be stored in a fixed-size stamp
+    uint32_t hash = 0x811C9DC5;
+    while (*name)
+        hash = (hash ^ (uint8_t)*name++) * 0x01000193;
+    return hash;
+}
+
+static uint32_t addName(const char *name)
+{
+    // Append a null-terminated name to the string arena and return its offset
+    uint32_t offset = songNames.length();
+    songNames.append(name, strlen(name) + 1);
+    return offset;
+}
+
+static bool parseKey(std::string &str, uint16_t &id, size_t &key)
+{
+    // Get the song ID from an entry in the form "pv_XXX.key=value"
+    if (str.compare(0, 3, "pv_") != 0 || (key = str.find('.')) == std::string::npos || key < 4 || key > 8)
+        return false;
+    for (size_t i = 3; i < key; i++)
+        if (str[i] < '0' || str[i] > '9')
+            return false;
+
+    // Reject IDs that don't fit in the table, and point to the start of the key
+    int num = std::stoi(str.substr(3, key - 3));
+    if (num > 0xFFFF)
+        return false;
+    id = num;
+    key++;
+    return true;
+}
+
+static void parseDatabase(std::string &path, std::map<uint16_t, std::vector<std::string>> &lyrics)
+{
+    // Scan a database file (.txt) for English song information, which may be packed
+    uint32_t base, size;
+    if (FILE *file = openFile(path, base, size))
+    {
+        char line[512];
+        while (ftell(file) < (long)(base + size) && fgets(line, 512, file))
+        {
+            std::string str = line;
+            uint16_t id;
+            size_t key;
+            if (!parseKey(str, id, key))
+                continue;
+
+            if (str.length() > key + 13 && str.compare(key, 13, "song_name_en=") == 0)
+            {
+                // Set a song name from the database
+                std::string name = str.substr(key + 13);
+                formatString(name);
+                addSong(id).name = addName(name.c_str());
+            }
+            else if (str.length() > key + 9 && str.compare(key, 9, "lyric_en.") == 0)
+            {
+                // Set a song lyric from the database
+                size_t value = str.find('=', key + 9);
+                if (value == std::string::npos)
+                    continue;
+                std::string lyric = str.substr(value + 1);
+                formatString(lyric);
+                std::vector<std::string> &songLyrics = lyrics[addSong(id).id];
+                size_t index = std::stoi(str.substr(key + 9, value - (key + 9)));
+                if (index >= songLyrics.size())
+                    songLyrics.resize(index + 1);
+                songLyrics[index] = lyric;
+            }
+            else if (str.compare(key, 11, "difficulty.") == 0)
+            {
+                for (int i = 0; i < 5; i++)
+                {
+                    // Check for an entry in the form "difficulty.<diff>.level=PV_LV_XX_X"
+                    size_t value = key + 11 + diffs[i].length() + 6;
+                    if (str.length() <= value + 10 || str.compare(key + 11, diffs[i].length(), diffs[i]) != 0 ||
+                        str.compare(value - 6, 6, "level=") != 0)
+                        continue;
+
+                    // Set a difficulty level as fixed-point with a 1-bit fractional
+                    uint32_t diff = std::stoi(str.substr(value + 6, 2)) * 2 + std::stoi(str.substr(value + 9, 1)) / 5;
+                    SongData &song = addSong(id);
+                    song.difficulty = (song.difficulty & ~(0x1F << (i * 5))) | ((diff & 0x1F) << (i * 5));
+                    break;
+                }
+            }
+        }
+
+        fclose(file);
+    }
+}
+
+static bool loadCache(std::vector<CacheStamp> &stamps)
+{
+    FILE *file = fopen("/project-ds/db.cache", "rb");
+    if (!file) return false;
+
+    // Read the header and make sure it matches the current database files
+    CacheHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || header.magic != CACHE_MAGIC ||
+        header.version != CACHE_VERSION || header.fileCount != stamps.size())
+    {
+        fclose(file);
+        return false;
+    }
+
+    // Read the rest of the cache in one go, leaving the lyrics to be loaded per song
+    size_t stampsSize = stamps.size() * sizeof(CacheStamp);
+    uint8_t *data = new uint8_t[stampsSize + header.dataSize];
+    bool valid = (fread(data, sizeof(uint8_t), stampsSize + header.dataSize, file) == stampsSize + header.dataSize);
+    fclose(file);
+
+    // Rebuild the cache if any database file was added, removed, or modified
+    if (!valid || memcmp(data, &stamps[0], stampsSize) != 0)
+    {
+        delete[] data;
+        return false;
+    }
+
+    // Use the cached name data directly as the string arena
+    CacheSong *songs = (CacheSong*)&data[stampsSize];
+    const char *strings = (const char*)&songs[header.songCount];
+    songNames.assign(strings, header.dataSize - header.songCount * sizeof(CacheSong));
+
+    // Fill out the song table from the cached entries, which are already sorted by ID
+    uint32_t lyricsBase = sizeof(header) + stampsSize + header.dataSize;
+    songData.resize(header.songCount);
+    for (size_t i = 0; i < header.songCount; i++)
+    {
+        SongData &song = songData[i];
+        song.id = songs[i].id;
+        song.name = songs[i].name;
+        song.difficulty = songs[i].difficulty;
+
+        // Remember where the song's lyrics are in the cache file
+        song.lyricOffset = lyricsBase + songs[i].lyrics;
+        song.lyricSize = songs[i].lyricsSize;
+        song.lyricCount = songs[i].lyricCount;
+    }
+
+    delete[] data;
+    return true;
+}
+
+static void writeCache(std::vector<CacheStamp> &stamps, std::map<uint16_t, std::vector<std::string>> &lyrics)
+{
+    std::vector<CacheSong> songs;
+    std::string lyricStrings;
+
+    // Build entries for all songs, with name offsets matching the string arena
+    for (size_t i = 0; i < songData.size(); i++)
+    {
+        CacheSong song;
+        song.id = songData[i].id;
+        song.difficulty = songData[i].difficulty;
+        song.name = songData[i].name;
+
+        // Add the lyrics to their own section, as consecutive null-terminated strings
+        std::vector<std::string> &songLyrics = lyrics[song.id];
+        song.lyricCount = songLyrics.size();
+        song.lyrics = lyricStrings.length();
+        for (size_t j = 0; j < song.lyricCount; j++)
+            lyricStrings.append(songLyrics[j].c_str(), songLyrics[j].length() + 1);
+        song.lyricsSize = lyricStrings.length() - song.lyrics;
+
+        songs.push_back(song);
+    }
+
+    if (FILE *file = fopen("/project-ds/db.cache", "wb"))
+    {
+        // Write the header, stamps, song entries, and string data
+        CacheHeader header;
+        header.magic = CACHE_MAGIC;
+        header.version = CACHE_VERSION;
+        header.fileCount = stamps.size();
+        header.songCount = songs.size();
+        header.dataSize = songs.size() * sizeof(CacheSong) + songNames.length();
+        header.lyricsSize = lyricStrings.length();
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(stamps.data(), sizeof(CacheStamp), stamps.size(), file);
+        fwrite(songs.data(), sizeof(CacheSong), songs.size(), file);
+        fwrite(songNames.data(), sizeof(char), songNames.length(), file);
+        fwrite(lyricStrings.data(), sizeof(char), lyricStrings.length(), file);
+        fclose(file);
+    }
+}
+
+static bool importScores()
+{
+    // Load saved score information from the old text format if it exists
+    FILE *file = fopen("/project-ds/scores.txt", "r");
+    if (!file) return false;
+
+    char line[512];
+    while (fgets(line, 512, file))
+    {
+        std::string str = line;
+        uint16_t id;
+        size_t key;
+        if (!parseKey(str, id, key))
+            continue;
+
+        // Parse the difficulty index from the line
+        uint8_t diff;
+        for (diff = 0; diff < 5; diff++)
+            if (str.compare(key, diffs[diff].length(), diffs[diff]) == 0)
+                break;
+        if (diff == 5)
+            continue;
+
+        // Set the appropriate value based on the entry
+        SongData &song = addSong(id);
+        size_t value = key + diffs[diff].length();
+        if (str.length() > value + 6 && str.compare(value, 6, "score=") == 0)
+            song.scores[diff] = std::stoi(str.substr(value + 6));
+        else if (str.length() > value + 6 && str.compare(value, 6, "clear=") == 0)
+            song.clears[diff] = std::stof(str.substr(value + 6));
+        else if (str.length() > value + 5 && str.compare(value, 5, "rank=") == 0)
+            song.ranks[diff] = std::stoi(str.substr(value + 5));
+    }
+
+    fclose(file);
+    return true;
+}
+
+static void appendRecord(FILE *file, SongData &song, uint8_t diff)
+{
+    // Write a record with the current score information for a song difficulty, protected by a CRC
+    ScoreRecord record;
+    record.id = song.id;
+    record.difficulty = diff;
+    record.rank = song.ranks[diff];
+    record.score = song.scores[diff];
+    record.clear = song.clears[diff];
+    record.reserved = 0;
+    record.crc = swiCRC16(0xFFFF, &record, sizeof(record) - sizeof(record.crc));
+    fwrite(&record, sizeof(record), 1, file);
+}
+
+static void compactScores()
+{
+    // Write a new journal with only one record for each saved score
+    FILE *file = fopen("/project-ds/scores.tmp", "wb");
+    if (!file) return;
+    for (size_t i = 0; i < songData.size(); i++)
+        for (uint8_t diff = 0; diff < 5; diff++)
+            if (songData[i].scores[diff] || songData[i].clears[diff] || songData[i].ranks[diff])
+                appendRecord(file, songData[i], diff);
+    fclose(file);
+
+    // Replace the old journal; if this is interrupted, the new one is picked up on next boot
+    remove("/project-ds/scores.bin");
+    rename("/project-ds/scores.tmp", "/project-ds/scores.bin");
+}
+
+static void loadScores()
+{
+    // Recover from an interrupted compaction, or discard an incomplete one
+    FILE *file = fopen("/project-ds/scores.bin", "rb");
+    if (!file && !rename("/project-ds/scores.tmp", "/project-ds/scores.bin"))
+        file = fopen("/project-ds/scores.bin", "rb");
+    else
+        remove("/project-ds/scores.tmp");
+
+    if (!file)
+    {
+        // Convert scores from the old text format to a new journal
+        if (importScores())
+            compactScores();
+        return;
+    }
+
+    // Read the whole journal in one go
+    fseek(file, 0, SEEK_END);
+    size_t size = ftell(file);
+    size_t count = size / sizeof(ScoreRecord);
+    fseek(file, 0, SEEK_SET);
+    ScoreRecord *records = new ScoreRecord[count];
+    count = fread(records, sizeof(ScoreRecord), count, file);
+    fclose(file);
+
+    // Replay the records in order, stopping at one that was only partially written
+    size_t valid, entries = 0;
+    for (valid = 0; valid < count; valid++)
+    {
+        ScoreRecord &record = records[valid];
+        if (record.crc != swiCRC16(0xFFFF, &record, sizeof(record) - sizeof(record.crc)) || record.difficulty >= 5)
+            break;
+
+        SongData &song = addSong(record.id);
+        uint8_t diff = record.difficulty;
+        if (!song.scores[diff] && !song.clears[diff] && !song.ranks[diff])
+            entries++;
+        song.scores[diff] = record.score;
+        song.clears[diff] = record.clear;
+        song.ranks[diff] = record.rank;
+    }
+
+    delete[] records;
+
+    // Compact the journal if it was damaged or is mostly made of outdated records
+    if (valid < count || size % sizeof(ScoreRecord) || valid > entries * 2 + 64)
+        compactScores();
+}
+
 void databaseInit()
 {
-    // Assign default song names as fallbacks
-    for (size_t i = 0; i < 1000; i++)
+    std::vector<std::string> names;
+    std::vector<CacheStamp> stamps;
+
+    // Find packed database files (.txt) and stamp them with their sizes and the pack's modification time
+    for (size_t i = 0; i < packCount(); i++)
     {
-        std::string num = std::to_string(i);
-        songData[i].name = "pv_" + std::string(3 - num.length(), '0') + num;
+        std::string name = packName(i);
+        if (name.compare(0, 3, "db/") == 0 && name.length() > 4 && name.substr(name.length() - 4) == ".txt")
+        {
+            names.push_back("/project-ds/" + name);
+            stamps.push_back({ hashName(name.c_str()), packSize(i), packTime() });
+        }
     }
 
-    // Scan database files (.txt) for English song information
+    // Find loose database files (.txt) and stamp them with their sizes and modification times
     if (DIR *dir = opendir("/project-ds/db"))
     {
         while (dirent *entry = readdir(dir))
         {
             std::string name = (std::string)"/project-ds/db/" + entry->d_name;
-            if (name.substr(name.length() - 4) == ".txt")
+            struct stat st;
+            if (name.substr(name.length() - 4) == ".txt" && stat(name.c_str(), &st) == 0)
             {
-                if (FILE *file = fopen(name.c_str(), "r"))
-                {
-                    char line[512];
-                    while (fgets(line, 512, file))
-                    {
-                        std::string str = line;
-                        if (str.length() > 20 && str.substr(7, 13) == "song_name_en=")
-                        {
-                            // Set a song name from the database
-                            std::string name = str.substr(20);
-                            formatString(name);
-                            songData[std::stoi(str.substr(3, 3))].name = name;
-                        }
-                        else if (str.length() > 20 && str.substr(7, 9) == "lyric_en.")
-                        {
-                            // Set a song lyric from the database
-                            std::string lyric = str.substr(20);
-                            formatString(lyric);
-                            std::vector<std::string> &lyrics = songData[std::stoi(str.substr(3, 3))].lyrics;
-                            size_t index = std::stoi(str.substr(16, 3));
-                            lyrics.resize(index + 1);
-                            lyrics[index] = lyric;
-                        }
-                        else if (str.length() > 41 && str.substr(7, 24) == "difficulty.easy.0.level=")
-                        {
-                            // Set an easy difficulty level as fixed-point with a 1-bit fractional
-                            uint8_t diff = std::stoi(str.substr(37, 2)) * 2 + std::stoi(str.substr(40, 1)) / 5;
-                            songData[std::stoi(str.substr(3, 3))].diffEasy = diff;
-                        }
-                        else if (str.length() > 43 && str.substr(7, 26) == "difficulty.normal.0.level=")
-                        {
-                            // Set a normal difficulty level as fixed-point with a 1-bit fractional
-                            uint8_t diff = std::stoi(str.substr(39, 2)) * 2 + std::stoi(str.substr(42, 1)) / 5;
-                            songData[std::stoi(str.substr(3, 3))].diffNorm = diff;
-                        }
-                        else if (str.length() > 41 && str.substr(7, 24) == "difficulty.hard.0.level=")
-                        {
-                            // Set a hard difficulty level as fixed-point with a 1-bit fractional
-                            uint8_t diff = std::stoi(str.substr(37, 2)) * 2 + std::stoi(str.substr(40, 1)) / 5;
-                            songData[std::stoi(str.substr(3, 3))].diffHard = diff;
-                        }
-                        else if (str.length() > 44 && str.substr(7, 27) == "difficulty.extreme.0.level=")
-                        {
-                            // Set an extreme difficulty level as fixed-point with a 1-bit fractional
-                            uint8_t diff = std::stoi(str.substr(40, 2)) * 2 + std::stoi(str.substr(43, 1)) / 5;
-                            songData[std::stoi(str.substr(3, 3))].diffExtr = diff;
-                        }
-                        else if (str.length() > 44 && str.substr(7, 27) == "difficulty.extreme.1.level=")
-                        {
-                            // Set an extra extreme difficulty level as fixed-point with a 1-bit fractional
-                            uint8_t diff = std::stoi(str.substr(40, 2)) * 2 + std::stoi(str.substr(43, 1)) / 5;
-                            songData[std::stoi(str.substr(3, 3))].diffExEx = diff;
-                        }
-                    }
-
-                    fclose(file);
-                }
+                names.push_back(name);
+                stamps.push_back({ hashName(entry->d_name), (uint32_t)st.st_size, (uint32_t)st.st_mtime });
             }
         }
 
         closedir(dir);
     }
 
-    // Load saved score information from file if it exists
-    if (FILE *file = fopen("/project-ds/scores.txt", "r"))
+    // Only parse the database files if the cache is missing or out of date
+    if (!stamps.empty() && !loadCache(stamps))
     {
-        char line[512];
-        while (fgets(line, 512, file))
-        {
-            std::string str = line;
+        std::map<uint16_t, std::vector<std::string>> lyrics;
+        for (size_t i = 0; i < names.size(); i++)
+            parseDatabase(names[i], lyrics);
 
-            // Parse the difficulty index from the line
-            uint8_t diff, len;
-            for (diff = 0; diff < 4; diff++)
-                if (str.substr(7, (len = diffs[diff].length())) == diffs[diff])
-                    break;
+        // Write the cache and reload it so lyrics can be located without keeping them in memory
+        writeCache(stamps, lyrics);
+        lyrics.clear();
+        loadCache(stamps);
+    }
 
-            // Set the appropriate value based on the entry
-            if (str.length() > 13 + len && str.substr(7 + len, 6) == "score=")
-                songData[std::stoi(str.substr(3, 3))].scores[diff] = std::stoi(str.substr(13 + len));
-            else if (str.length() > 13 + len && str.substr(7 + len, 6) == "clear=")
-                songData[std::stoi(str.substr(3, 3))].clears[diff] = std::stof(str.substr(13 + len));
-            else if (str.length() > 12 + len && str.substr(7 + len, 5) == "rank=")
-                songData[std::stoi(str.substr(3, 3))].ranks[diff] = std::stoi(str.substr(12 + len));
-        }
+    // Load saved score information
+    loadScores();
+    memoryTag(MEMORY_SONGS, songData.capacity() * sizeof(SongData) + songNames.capacity());
+}
 
-        fclose(file);
-    }
+SongData *findSong(uint16_t id)
+{
+    // Binary search the sorted song table for an ID
+    auto it = std::lower_bound(songData.begin(), songData.end(), id,
+        [](const SongData &song, uint16_t id) { return song.id < id; });
+    return (it != songData.end() && it->id == id) ? &*it : nullptr;
+}
+
+SongData &addSong(uint16_t id)
+{
+    // Find where the song belongs in the sorted table, and return it if it already exists
+    auto it = std::lower_bound(songData.begin(), songData.end(), id,
+        [](const SongData &song, uint16_t id) { return song.id < id; });
+    if (it != songData.end() && it->id == id)
+        return *it;
+
+    // Insert a new song with a default name as a fallback
+    char name[9];
+    sprintf(name, "pv_%03u", id);
+    it = songData.insert(it, SongData());
+    it->id = id;
+    it->name = addName(name);
+    memoryTag(MEMORY_SONGS, songData.capacity() * sizeof(SongData) + songNames.capacity());
+    return *it;
 }
 
-void writeScores()
+const char *getSongName(SongData &song)
 {
-    // Write saved score information to file
-    if (FILE *file = fopen("/project-ds/scores.txt", "w"))
+    // Get a song's name from the string arena
+    return &songNames[song.name];
+}
+
+static void layoutLyric(char *rows, const char *lyric)
+{
+    // Fill the lyric rows with spaces, terminated so they can be printed at once
+    memset(rows, ' ', LYRIC_SIZE);
+    rows[LYRIC_SIZE] = '\0';
+    size_t length = strlen(lyric);
+
+    if (length > 32)
     {
-        for (size_t i = 0; i < 1000; i++)
+        // Split the lyric into two lines at the last space that fits, and center them on the outer rows
+        size_t split = 31;
+        while (split > 0 && lyric[split] != ' ')
+            split--;
+
+        if (lyric[split] != ' ')
         {
-            for (uint8_t diff = 0; diff < 5; diff++)
-            {
-                // Add an entry for each non-zero score value
-                if (songData[i].scores[diff])
-                    fprintf(file, "pv_%03u.%sscore=%lu\n", i, diffs[diff].c_str(), songData[i].scores[diff]);
-                if (songData[i].clears[diff])
-                    fprintf(file, "pv_%03u.%sclear=%.2f\n", i, diffs[diff].c_str(), songData[i].clears[diff]);
-                if (songData[i].ranks[diff])
-                    fprintf(file, "pv_%03u.%srank=%u\n", i, diffs[diff].c_str(), songData[i].ranks[diff]);
-            }
+            // Without a space, run the whole lyric from the middle of the top row and start the bottom row over
+            // This matches how the original drawing code showed them, clipped to the three lyric rows
+            memcpy(&rows[16], lyric, std::min<size_t>(LYRIC_SIZE - 16, length));
+            memcpy(&rows[64], lyric, 32);
+            return;
         }
 
+        memcpy(&rows[(32 - split) / 2], lyric, split);
+        size_t rest = std::min<size_t>(32, length - (split + 1));
+        memcpy(&rows[64 + (32 - rest) / 2], &lyric[split + 1], rest);
+    }
+    else
+    {
+        // Center the lyric on the middle row
+        memcpy(&rows[32 + (32 - length) / 2], lyric, length);
+    }
+}
+
+uint32_t cacheStamp()
+{
+    // Identify the current database cache by its size and modification time
+    struct stat st;
+    if (stat("/project-ds/db.cache", &st) != 0)
+        return 0;
+    return (uint32_t)st.st_mtime ^ ((uint32_t)st.st_size << 8);
+}
+
+void loadLyrics(SongData &song)
+{
+    freeLyrics();
+    if (!song.lyricCount)
+        return;
+
+    // Read the song's lyrics from the cache file
+    std::vector<char> strings(song.lyricSize + 1);
+    FILE *file = fopen("/project-ds/db.cache", "rb");
+    if (!file || fseek(file, song.lyricOffset, SEEK_SET) != 0 ||
+        fread(strings.data(), sizeof(char), song.lyricSize, file) != song.lyricSize)
+    {
+        if (file) fclose(file);
+        return;
+    }
+    fclose(file);
+
+    // Lay out each of the consecutive null-terminated strings ahead of time, so showing one during gameplay is a single print
+    lyricArena = new char[song.lyricCount * (LYRIC_SIZE + 1)];
+    // Leave any lyrics past the end of the strings blank, in case the cache has fewer than its count says
+    const char *lyric = strings.data();
+    const char *end = strings.data() + song.lyricSize;
+    for (size_t i = 0; i < song.lyricCount; i++)
+    {
+        layoutLyric(&lyricArena[i * (LYRIC_SIZE + 1)], (lyric < end) ? lyric : "");
+        if (lyric < end)
+            lyric += strlen(lyric) + 1;
+    }
+    lyricCount = song.lyricCount;
+    memoryTag(MEMORY_LYRICS, lyricCount * (LYRIC_SIZE + 1));
+}
+
+const char *getLyric(size_t index)
+{
+    // Get a lyric's rows from the loaded song, or nothing if it doesn't exist
+    if (index >= lyricCount)
+        return nullptr;
+    return &lyricArena[index * (LYRIC_SIZE + 1)];
+}
+
+void freeLyrics()
+{
+    // Free the currently loaded lyrics
+    delete[] lyricArena;
+    lyricArena = nullptr;
+    lyricCount = 0;
+    memoryTag(MEMORY_LYRICS, 0);
+}
+
+void writeScore(SongData &song, uint8_t diff)
+{
+    // Append the updated score information to the journal
+    if (FILE *file = fopen("/project-ds/scores.bin", "ab"))
+    {
+        appendRecord(file, song, diff);
         fclose(file);
     }
 }
@@ -20,13 +20,20 @@
 #ifndef DATABASE_H
 #define DATABASE_H
 
-#include <string>
+#include <cstdint>
 #include <vector>
 
+// Lyrics are laid out as 3 rows of the bottom screen console, from row 10
+#define LYRIC_ROW 10
+#define LYRIC_SIZE (32 * 3)
+
 struct SongData
 {
-    std::string name;
-    std::vector<std::string> lyrics;
+    uint16_t id = 0;
+    uint16_t lyricCount = 0;
+    uint32_t name = 0;
+    uint32_t lyricOffset = 0;
+    uint32_t lyricSize = 0;
 
     union
     {
@@ -47,9 +54,19 @@ struct SongData
     uint8_t ranks[5] = {};
 };
 
-extern SongData songData[1000];
+extern std::vector<SongData> songData;
 
 extern void databaseInit();
-extern void writeScores();
+
+extern SongData *findSong(uint16_t id);
+extern SongData &addSong(uint16_t id);
+extern const char *getSongName(SongData &song);
+
+extern uint32_t cacheStamp();
+extern void loadLyrics(SongData &song);
+extern const char *getLyric(size_t index);
+extern void freeLyrics();
+
+extern void writeScore(SongData &song, uint8_t diff);
 
 #endif // DATABASE_H
@@ -0,0 +1,212 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cstdio>
+#include <malloc.h>
+#include <nds.h>
+
+#include "debug.h"
+
+// Sprite VRAM available on each screen, from the 128KB banks mapped in main()
+#define VRAM_SIZE 0x20000
+
+static const char *tagNames[MEMORY_COUNT] =
+{
+    "Songs", "Lyrics", "Menu", "Pack", "Chart", "Notes", "Audio", "Effects"
+};
+
+static size_t tagBytes[MEMORY_COUNT];
+static size_t tagPeaks[MEMORY_COUNT];
+static size_t vramBytes[2];
+static size_t heapPeak = 0;
+
+void memorySample()
+{
+    // Track the heap's high-water mark, which is only as precise as how often this is called
+    heapPeak = std::max<size_t>(heapPeak, mallinfo().uordblks);
+}
+
+void memoryTag(MemoryTag tag, size_t bytes)
+{
+    // Set how much memory a subsystem is using, and check the heap when it reaches a new high-water mark
+    tagBytes[tag] = bytes;
+    if (bytes > tagPeaks[tag])
+    {
+        tagPeaks[tag] = bytes;
+        memorySample();
+    }
+}
+
+void memoryVram(bool sub, size_t bytes)
+{
+    // Count sprite VRAM that was allocated on a screen
+    vramBytes[sub] += bytes;
+}
+
+void memoryScreen()
+{
+    // Show the heap and sprite VRAM usage, along with what each subsystem is using
+    memorySample();
+    struct mallinfo info = mallinfo();
+    consoleClear();
+    printf("Memory usage\n\n");
+    printf("Heap  %7uKB used\n", info.uordblks / 1024);
+    printf("      %7uKB peak\n", heapPeak / 1024);
+    printf("      %7uKB arena peak\n\n", info.usmblks / 1024);
+
+    printf("           Now    Peak\n");
+    for (int i = 0; i < MEMORY_COUNT; i++)
+        printf("%-8s %5uKB %5uKB\n", tagNames[i], tagBytes[i] / 1024, tagPeaks[i] / 1024);
+
+    printf("\nVRAM  %3uKB/%uKB main\n", vramBytes[0] / 1024, VRAM_SIZE / 1024);
+    printf("      %3uKB/%uKB sub\n", vramBytes[1] / 1024, VRAM_SIZE / 1024);
+    printf("\x1b[23;0HPress B to return.");
+
+    // Wait until the screen is closed
+    do
+    {
+        swiWaitForVBlank();
+        scanKeys();
+    }
+    while (!(keysDown() & KEY_B));
+    consoleClear();
+}
+
+void memoryLog(const char *state)
+{
+    // Append the current usage to the memory log, so transitions between menus and games can be compared
+    memorySample();
+    FILE *file = fopen("/project-ds/memory.log", "a");
+    if (!file) return;
+    struct mallinfo info = mallinfo();
+    fprintf(file, "%s: heap %u used, %u peak, %u arena peak;", state, info.uordblks, heapPeak, info.usmblks);
+    for (int i = 0; i < MEMORY_COUNT; i++)
+        fprintf(file, " %s %u", tagNames[i], tagBytes[i]);
+    fprintf(file, "; VRAM %u main, %u sub\n", vramBytes[0], vramBytes[1]);
+    fclose(file);
+}
+
+#ifdef PROFILE
+
+// Bus clock ticks in one frame at 59.8261Hz
+#define FRAME_TICKS 560190
+
+static const char *sectionNames[PROFILE_COUNT] =
+{
+    "audio", "chart", "input", "sprites", "output", "idle"
+};
+
+static bool timerRunning = false;
+static uint16_t lastTick = 0;
+static uint32_t frameTicks[PROFILE_COUNT];
+static uint64_t totalTicks[PROFILE_COUNT];
+static uint32_t maxTicks[PROFILE_COUNT];
+static uint64_t busyTotal = 0;
+static uint32_t busyMax = 0;
+static uint32_t frames = 0;
+
+void profileReset()
+{
+    // Start a free-running timer at 1/64 of the bus clock, which wraps every 125ms
+    // Timer 1 is the only free one; the song stream uses timer 0, and the latency test uses timers 2 and 3
+    if (!timerRunning)
+    {
+        TIMER_DATA(1) = 0;
+        TIMER_CR(1) = TIMER_ENABLE | TIMER_DIV_64;
+        timerRunning = true;
+    }
+
+    // Clear the collected times
+    std::fill(frameTicks, frameTicks + PROFILE_COUNT, 0);
+    std::fill(totalTicks, totalTicks + PROFILE_COUNT, 0);
+    std::fill(maxTicks, maxTicks + PROFILE_COUNT, 0);
+    busyTotal = busyMax = frames = 0;
+}
+
+void profileStart()
+{
+    // Begin timing a frame, leaving out anything that happened between frames like menus
+    lastTick = TIMER_DATA(1);
+}
+
+void profileMark(ProfileSection section)
+{
+    // Charge the time since the last mark to a section, in bus clock ticks
+    uint16_t tick = TIMER_DATA(1);
+    frameTicks[section] += (uint16_t)(tick - lastTick) * 64;
+    lastTick = tick;
+}
+
+void profileEnd()
+{
+    // Charge the wait for the next frame as idle time, and add the frame to the totals
+    profileMark(PROFILE_IDLE);
+    uint32_t busy = 0;
+    for (int i = 0; i < PROFILE_COUNT; i++)
+    {
+        totalTicks[i] += frameTicks[i];
+        maxTicks[i] = std::max(maxTicks[i], frameTicks[i]);
+        if (i != PROFILE_IDLE)
+            busy += frameTicks[i];
+        frameTicks[i] = 0;
+    }
+
+    busyTotal += busy;
+    busyMax = std::max(busyMax, busy);
+    frames++;
+}
+
+void profileDraw()
+{
+    // Show how much of a frame is spent working, on average and at worst
+    if (frames)
+    {
+        printf("\x1b[21;0HCPU %3lu%% avg %3lu%% max", (uint32_t)(busyTotal * 100 / frames / FRAME_TICKS),
+            busyMax * 100 / FRAME_TICKS);
+    }
+}
+
+void profileSave(const char *name)
+{
+    // Append the chart's results to the profile log, so builds can be compared on the same charts
+    if (!frames) return;
+    FILE *file = fopen("/project-ds/profile.log", "a");
+    if (!file) return;
+
+#ifdef TCM
+    fprintf(file, "%s (TCM build), %lu frames\n", name, frames);
+#else
+    fprintf(file, "%s, %lu frames\n", name, frames);
+#endif
+
+    // Log each section in microseconds per frame
+    for (int i = 0; i < PROFILE_COUNT; i++)
+    {
+        fprintf(file, "  %-8s %6lluus avg %6lluus max\n", sectionNames[i],
+            totalTicks[i] * 1000000 / BUS_CLOCK / frames, (uint64_t)maxTicks[i] * 1000000 / BUS_CLOCK);
+    }
+
+    fprintf(file, "  %-8s %6lluus avg %6lluus max\n", "busy",
+        busyTotal * 1000000 / BUS_CLOCK / frames, (uint64_t)busyMax * 1000000 / BUS_CLOCK);
+    fclose(file);
+}
+
+#endif // PROFILE
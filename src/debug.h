@@ -0,0 +1,87 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef DEBUG_H
+#define DEBUG_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Place the hot gameplay code and state in the ARM9's tightly coupled memory when building with TCM=1
+// This only covers the profiler's chart section and the state it touches, since that's the work that grows with note density
+// The placement is chosen by hand, not generated from profile.log; compare logs from builds with and without TCM=1
+#ifdef TCM
+#define HOT_CODE ITCM_CODE
+#define HOT_DATA DTCM_DATA
+#define HOT_BSS  DTCM_BSS
+#else
+#define HOT_CODE
+#define HOT_DATA
+#define HOT_BSS
+#endif
+
+enum ProfileSection
+{
+    PROFILE_AUDIO = 0,
+    PROFILE_CHART,
+    PROFILE_INPUT,
+    PROFILE_SPRITES,
+    PROFILE_OUTPUT,
+    PROFILE_IDLE,
+    PROFILE_COUNT
+};
+
+enum MemoryTag
+{
+    MEMORY_SONGS = 0,
+    MEMORY_LYRICS,
+    MEMORY_MENU,
+    MEMORY_PACK,
+    MEMORY_CHART,
+    MEMORY_NOTES,
+    MEMORY_AUDIO,
+    MEMORY_EFFECTS,
+    MEMORY_COUNT
+};
+
+extern void memoryTag(MemoryTag tag, size_t bytes);
+extern void memoryVram(bool sub, size_t bytes);
+extern void memorySample();
+extern void memoryScreen();
+extern void memoryLog(const char *state);
+
+// Time each part of gameplay frames when building with PROFILE=1, and do nothing otherwise
+#ifdef PROFILE
+extern void profileReset();
+extern void profileStart();
+extern void profileMark(ProfileSection section);
+extern void profileEnd();
+extern void profileDraw();
+extern void profileSave(const char *name);
+#else
+inline void profileReset() {}
+inline void profileStart() {}
+inline void profileMark(ProfileSection section) {}
+inline void profileEnd() {}
+inline void profileDraw() {}
+inline void profileSave(const char *name) {}
+#endif
+
+#endif // DEBUG_H
@@ -0,0 +1,154 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cmath>
+#include <nds.h>
+
+#include "debug.h"
+#include "effects.h"
+#include "pack.h"
+
+#define EFFECT_RATE 22050
+#define MAX_VOICES 4
+
+struct Sample
+{
+    int16_t *data;
+    uint32_t size;
+};
+
+static Sample samples[EFFECT_COUNT];
+static int voices[MAX_VOICES];
+static uint32_t voiceEnds[MAX_VOICES];
+static uint32_t frameCount = 0;
+
+static bool latencyTest = false;
+static uint32_t latencySum = 0;
+static uint32_t latencyMax = 0;
+static uint32_t latencyCount = 0;
+
+static void loadSample(Sample &sample, const char *name, float freq1, float freq2, float length)
+{
+    // Load a custom sample (raw signed 16-bit mono at 22050Hz) into main RAM if one exists
+    uint32_t base;
+    std::string path = (std::string)"/project-ds/se/" + name + ".pcm";
+    sample.data = nullptr;
+    sample.size = 0;
+    if (FILE *file = openFile(path, base, sample.size))
+    {
+        sample.size &= ~0x3;
+        if (sample.size)
+        {
+            sample.data = new int16_t[sample.size / 2];
+            sample.size = fread(sample.data, sizeof(int16_t), sample.size / 2, file) * 2 & ~0x3;
+        }
+        fclose(file);
+    }
+
+    // Otherwise synthesize a short tone that sweeps between two frequencies and decays quickly
+    // An empty or unreadable custom sample is treated the same as a missing one
+    if (!sample.size)
+    {
+        delete[] sample.data;
+        size_t count = (size_t)(EFFECT_RATE * length) & ~0x1;
+        sample.data = new int16_t[count];
+        sample.size = count * 2;
+        float phase = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            float t = (float)i / count;
+            phase += 2 * M_PI * (freq1 + (freq2 - freq1) * t) / EFFECT_RATE;
+            sample.data[i] = sinf(phase) * (1 - t) * (1 - t) * 24000;
+        }
+    }
+
+    // Make sure the ARM7 sees the sample data rather than stale memory
+    DC_FlushRange(sample.data, sample.size);
+}
+
+void effectsInit()
+{
+    // Preload the hit sounds into main RAM so they can be played without any file access
+    soundEnable();
+    loadSample(samples[EFFECT_HIT],   "hit",   1760, 880,  0.05f);
+    loadSample(samples[EFFECT_SLIDE], "slide", 2640, 3520, 0.04f);
+    loadSample(samples[EFFECT_CHART], "chart", 1320, 1320, 0.15f);
+
+    for (int i = 0; i < MAX_VOICES; i++)
+        voices[i] = -1;
+
+    memoryTag(MEMORY_EFFECTS, samples[EFFECT_HIT].size + samples[EFFECT_SLIDE].size + samples[EFFECT_CHART].size);
+}
+
+void effectsFrame()
+{
+    // Count frames for voice tracking, and time from the start of the frame when input is read
+    frameCount++;
+    if (latencyTest)
+        cpuStartTiming(2);
+}
+
+void playEffect(Effect effect, int x)
+{
+    // Find a free voice, or take the one that finishes first
+    int voice = 0;
+    for (int i = 1; i < MAX_VOICES; i++)
+        if (voiceEnds[i] < voiceEnds[voice])
+            voice = i;
+
+    // Stop the voice's channel if it's still playing, so the number of channels used stays limited
+    if (voices[voice] >= 0 && voiceEnds[voice] > frameCount)
+        soundKill(voices[voice]);
+
+    // Play the sample on a spare hardware channel, panned towards where the note was
+    Sample &sample = samples[effect];
+    voices[voice] = soundPlaySample(sample.data, SoundFormat_16Bit, sample.size,
+        EFFECT_RATE, 100, std::min(127, std::max(0, x / 2)), false, 0);
+    voiceEnds[voice] = frameCount + (sample.size / 2) * 60 / EFFECT_RATE + 1;
+
+    // Measure the time between the start of the frame and the sound being sent to the ARM7
+    if (latencyTest)
+    {
+        uint32_t usec = (uint64_t)cpuGetTiming() * 1000000 / BUS_CLOCK;
+        latencySum += usec;
+        latencyMax = std::max(latencyMax, usec);
+        latencyCount++;
+    }
+}
+
+void setLatencyTest(bool enable)
+{
+    // Toggle latency measurement and reset its results
+    latencyTest = enable;
+    latencySum = latencyMax = latencyCount = 0;
+}
+
+bool getLatencyTest()
+{
+    return latencyTest;
+}
+
+void getLatency(uint32_t &average, uint32_t &maximum)
+{
+    // Get the average and maximum measured latency in microseconds
+    average = latencyCount ? (latencySum / latencyCount) : 0;
+    maximum = latencyMax;
+}
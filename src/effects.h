@@ -0,0 +1,42 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef EFFECTS_H
+#define EFFECTS_H
+
+#include <cstdint>
+
+enum Effect
+{
+    EFFECT_HIT = 0,
+    EFFECT_SLIDE,
+    EFFECT_CHART,
+    EFFECT_COUNT
+};
+
+extern void effectsInit();
+extern void effectsFrame();
+extern void playEffect(Effect effect, int x = 128);
+
+extern void setLatencyTest(bool enable);
+extern bool getLatencyTest();
+extern void getLatency(uint32_t &average, uint32_t &maximum);
+
+#endif // EFFECTS_H
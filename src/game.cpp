@@ -18,7 +18,9 @@
 */
 
 #include <cmath>
+#include <cstring>
 #include <deque>
+#include <vector>
 
 #include <nds.h>
 
@@ -52,11 +54,19 @@
 
 #include "game.h"
 #include "audio.h"
+#include "chart.h"
+#include "debug.h"
+#include "effects.h"
+#include "judge.h"
 #include "database.h"
 #include "menu.h"
+#include "pack.h"
 
-#define PI 3.14159
-#define FRAME_TIME 1672
+#define CHECKPOINT_TIME 100000
+
+#define SNAPSHOT_MAGIC 0x53534450 // "PDSS"
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_PATH "/project-ds/suspend.bin"
 
 struct Note
 {
@@ -69,53 +79,106 @@ struct Note
     uint32_t time;
 };
 
-static std::deque<Note> notes;
+// Chart state at the start of a frame, recorded every second for seeking
+struct Checkpoint
+{
+    uint32_t counter;
+    uint32_t flyTime;
+    int32_t lyric;
+    int32_t musicTime;
+};
+
+// Game state saved when suspending, followed by the queued notes
+struct Snapshot
+{
+    uint32_t magic;
+    uint32_t version;
+    char chartName[64];
+    char songName[64];
+    uint32_t chartSize;
+    uint32_t difficulty;
+    SongData song;
+    uint32_t cacheStamp;
+    uint32_t counter;
+    uint32_t timer;
+    uint32_t timerFrac;
+    uint32_t flyTime;
+    int32_t lyricIndex;
+    int32_t musicTime;
+    uint32_t audioOffset;
+    uint8_t finished;
+    uint8_t current;
+    uint8_t mask;
+    uint8_t mask2;
+    uint8_t holdNotes;
+    uint8_t holdStart;
+    uint8_t slideBroken;
+    uint8_t life;
+    uint16_t holdTime;
+    uint16_t holdScore;
+    uint32_t slideCount;
+    uint32_t combo;
+    uint32_t scoreRef;
+    int32_t speed;
+    uint32_t practiceStart;
+    uint32_t practiceEnd;
+    Results results;
+    uint32_t noteCount;
+};
+
+static HOT_BSS std::deque<Note> notes;
+static std::vector<Checkpoint> checkpoints;
+static uint32_t maxFlyTime = 0;
 
 static uint16_t *numGfx[10];
 static uint16_t *mainGfx[23];
 static uint16_t *multiGfx[9];
 static uint16_t *subGfx[2];
 
-static size_t chartSize = 0;
-static uint32_t *chart = nullptr;
+static std::vector<ChartEvent> chart;
+static std::vector<ChartEvent> nextChart;
+static std::string nextName;
+static std::string chartName;
 static std::string songName;
-
-static uint32_t counter = 1;
-static uint32_t timer = 0;
-static uint32_t flyTime = 100000;
-static bool finished = false;
-
-static uint8_t current = 0;
-static uint8_t mask = 0;
-static uint8_t mask2 = 0;
-static uint8_t statTimer = 0;
-
-static uint8_t holdNotes = 0;
-static uint8_t holdStart = 0;
-static uint16_t holdTime = 0;
-static uint16_t holdScore = 0;
-
-static uint32_t slideCount = 0;
-static bool slideBroken = false;
-
-static uint32_t combo = 0;
-static uint8_t life = 127;
+static size_t chartDifficulty = 0;
+static SongData songInfo;
+static bool restored = false;
+
+static HOT_BSS uint32_t counter = 0;
+static HOT_BSS uint32_t timer = 0;
+static HOT_DATA uint32_t flyTime = 100000;
+static HOT_BSS bool finished = false;
+static bool seeking = false;
+static int32_t lyricIndex = -1;
+static int32_t musicTime = -1;
+
+static size_t practiceStart = 0;
+static uint32_t practiceEnd = 0;
+static HOT_DATA int speed = 100;
+static HOT_BSS uint32_t timerFrac = 0;
+static volatile uint32_t vblankCount = 0;
+static uint32_t frameCount = 0;
+
+static HOT_BSS uint8_t current = 0;
+static HOT_BSS uint8_t mask = 0;
+static HOT_BSS uint8_t mask2 = 0;
+static HOT_BSS uint8_t statTimer = 0;
+
+static HOT_BSS uint8_t holdNotes = 0;
+static HOT_BSS uint8_t holdStart = 0;
+static HOT_BSS uint16_t holdTime = 0;
+static HOT_BSS uint16_t holdScore = 0;
+
+static HOT_BSS uint32_t slideCount = 0;
+static HOT_BSS bool slideBroken = false;
+
+static HOT_BSS uint32_t combo = 0;
+static HOT_DATA uint8_t life = 127;
 
 static uint32_t scoreRef = 0;
 static uint8_t holdDivide = 1;
 
-static Results results;
-
-static const uint8_t paramCounts[0x100] =
-{
-    0,  1,  4,  2,  2,  2,  7,  4,  2,  6,  2,  1,  6,  2,  1,  1, // 0x00-0x0F
-    3,  2,  3,  5,  5,  4,  4,  5,  2,  0,  2,  4,  2,  2,  1, 21, // 0x10-0x1F
-    0,  3,  2,  5,  1,  1,  7,  1,  1,  2,  1,  2,  1,  2,  3,  3, // 0x20-0x2F
-    1,  2,  2,  3,  6,  6,  1,  1,  2,  3,  1,  2,  2,  4,  4,  1, // 0x30-0x3F
-    2,  1,  2,  1,  1,  3,  3,  3,  2,  1,  9,  3,  2,  4,  2,  3, // 0x40-0x4F
-    2, 24,  1,  2,  1,  3,  1,  3,  4,  1,  2,  6,  3,  2,  3,  3, // 0x50-0x5F
-    4,  1,  1,  3,  3,  4,  2,  3,  3,  8,  2                      // 0x60-0x6A
-};
+static HOT_BSS Results results;
 
 static const uint16_t keys[6] =
 {
@@ -129,6 +192,9 @@ uint16_t *initObjBitmap(OamState *oam, const unsigned int *bitmap, size_t bitmap
     // Copy 16-color object tiles into appropriate memory, and return a pointer to the data
     uint16_t *gfx = oamAllocateGfx(oam, size, SpriteColorFormat_Bmp);
     if (gfx) dmaCopy(bitmap, gfx, bitmapLen);
+
+    // Count the sprite VRAM used, at 2 bytes per bitmap pixel
+    if (gfx) memoryVram(oam == &oamSub, SPRITE_SIZE_PIXELS(size) * 2);
     return gfx;
 }
 
@@ -158,8 +224,22 @@ static uint16_t *initObjBitmapMulti(OamState *oam, const unsigned int *bitmap, s
     return initObjBitmap(oam, (unsigned int*)data, bitmapLen, size);
 }
 
+static void countVBlank()
+{
+    // Count every VBlank so the game loop can tell how many frames actually passed
+    vblankCount++;
+}
+
+uint32_t getVBlanks()
+{
+    return vblankCount;
+}
+
 void gameInit()
 {
+    // Install the VBlank counter used to keep the chart in sync when frames overrun
+    irqSet(IRQ_VBLANK, countVBlank);
+
     // Allocate bitmap data for the combo numbers
     size_t len = combo_numsBitmapLen / 10;
     for (int i = 0; i < 10; i++)
@@ -209,249 +289,362 @@ void gameInit()
 static void clearLyrics()
 {
     // Clear lyrics with empty space so new ones can be drawn
-    for (int i = 10; i <= 12; i++)
-        printf("\x1b[%d;0H                                ", i);
+    printf("\x1b[%d;0H%*s", LYRIC_ROW, LYRIC_SIZE, "");
+}
+
+static void drawLyric(int32_t index)
+{
+    // Show a lyric on the bottom screen, using the rows laid out for it when the song was loaded
+    if (const char *lyric = (index >= 0) ? getLyric(index) : nullptr)
+        printf("\x1b[%d;0H%s", LYRIC_ROW, lyric);
+    else
+        clearLyrics();
 }
 
 static void processChart()
 {
     uint32_t score = 0;
-    uint32_t count = 1;
-    bool finish = false;
     bool multi = false;
 
     // Scan the whole chart and add up the reference score and total combo
-    while (count < chartSize && !finish)
+    for (size_t i = 0; i < chart.size(); i++)
     {
-        switch (chart[count])
+        if (chart[i].event == EVENT_TIME)
+        {
+            multi = false;
+        }
+        else if (chart[i].event == EVENT_NOTE)
         {
-            case 0x00: // End
+            // Add a score bonus and increment the total combo for combo-able notes
+            if (!multi && !(chart[i].type & BIT(7)))
             {
-                finish = true;
-                break;
+                score += 250;
+                results.total++;
             }
 
-            case 0x01: // Time
-            {
-                multi = false;
-                break;
-            }
+            // Increase the reference score
+            score += 500;
+            multi = true;
+        }
+    }
 
-            case 0x06: // Target
-            {
-                static Note note;
-                int32_t x = chart[count + 2] * 256 / 480000 - 16;
-                int32_t y = chart[count + 3] * 192 / 270000 - 16;
-
-                // Set the note type
-                if (chart[count + 1] < 8 || // Normal and held buttons
-                    chart[count + 1] == 12 || chart[count + 1] == 13 || // Single slides
-                    (chart[count + 1] >= 18 && chart[count + 1] < 22)) // Event notes
-                {
-                    // The note type doesn't matter for non-special cases, so ignore it
-                    note.type = 0;
-                }
-                else if (chart[count + 1] == 15) // Left held slide
-                {
-                    // Mark all held slides with bit 6, and non-initial ones with bit 7
-                    uint8_t type = 4 | BIT(6);
-                    if (type == (note.type & ~BIT(7)) && x < note.x && y == note.y)
-                        type |= BIT(7);
-                    note.type = type;
-                }
-                else if (chart[count + 1] == 16) // Right held slide
-                {
-                    // Mark all held slides with bit 6, and non-initial ones with bit 7
-                    uint8_t type = 5 | BIT(6);
-                    if (type == (note.type & ~BIT(7)) && x > note.x && y == note.y)
-                        type |= BIT(7);
-                    note.type = type;
-                }
-                else
-                {
-                    break;
-                }
+    // Set the reference score, adjusted for combos below 50
+    scoreRef = score - 7250;
+}
 
-                // Remember the current note's coordinates
-                note.x = x;
-                note.y = y;
+static HOT_CODE void advanceTimer()
+{
+    // Move the chart timer forward by a frame, scaled by the playback speed without losing the remainder
+    timerFrac += FRAME_TIME * speed;
+    timer += timerFrac / 100;
+    timerFrac %= 100;
+}
+
+static HOT_CODE void moveNotes()
+{
+    // Move all queued notes closer to their holes, and their timing arrows further along
+    for (size_t i = 0; i < notes.size(); i++)
+    {
+        notes[i].ofsX -= notes[i].incX;
+        notes[i].ofsY -= notes[i].incY;
+        if (!(notes[i].type & BIT(7)))
+            notes[i].ofsArrow -= notes[i].incArrow;
+    }
+}
+
+static HOT_CODE void updateHolds()
+{
+    // Add score bonuses for note holds
+    // TODO: draw the score bonus UI
+    if (!holdNotes)
+        return;
 
-                // Add a score bonus and increment the total combo for combo-able notes
-                if (!multi && !(note.type & BIT(7)))
+    if (holdStart == 12)
+    {
+        // Add a 10-point bonus per note hold every frame
+        for (int i = 0; i < 4; i++)
+        {
+            if (holdNotes & BIT(i))
+                results.scoreHold += 10;
+        }
+    }
+    else
+    {
+        // Queue a 10-point bonus per note hold every frame
+        for (int i = 0; i < 4; i++)
+        {
+            if (holdNotes & BIT(i))
+                holdScore += 10;
+        }
+
+        // After 12 frames, commit to the hold and add the queued bonus
+        if (++holdStart == 12)
+            results.scoreHold += holdScore;
+    }
+
+    if (++holdTime == 5 * 60) // 5 seconds
+    {
+        // Add a 1500-point bonus per note hold if the max hold time is reached
+        for (int i = 0; i < 4; i++)
+        {
+            if (holdNotes & BIT(i))
+                results.scoreHold += 1500;
+        }
+
+        // Cancel note holds after the max hold time is reached
+        holdNotes = 0;
+        holdStart = 0;
+        holdTime = 0;
+        holdScore = 0;
+    }
+}
+
+static uint32_t frameTime(size_t index)
+{
+    // Get the time of the first frame at or after a checkpoint
+    return (index * CHECKPOINT_TIME + FRAME_TIME - 1) / FRAME_TIME * FRAME_TIME;
+}
+
+static void buildCheckpoints()
+{
+    // Start with the state the chart begins with
+    Checkpoint state = { 0, 100000, -1, -1 };
+    checkpoints.assign(1, state);
+    maxFlyTime = state.flyTime;
+    uint32_t frame = 0;
+
+    // Scan the chart, tracking the state that affects seeking
+    for (uint32_t count = 0; count < chart.size() && chart[count].event != EVENT_END; count++)
+    {
+        switch (chart[count].event)
+        {
+            case EVENT_TIME:
+            {
+                // Record the state for every checkpoint frame that would start waiting at this event
+                while (frameTime(checkpoints.size()) < chart[count].value + FRAME_TIME)
                 {
-                    score += 250;
-                    results.total++;
+                    state.counter = count;
+                    checkpoints.push_back(state);
                 }
 
-                // Increase the reference score
-                score += 500;
-                multi = true;
+                // Track the frame the following events run in
+                frame = std::max(frame, (chart[count].value + FRAME_TIME - 1) / FRAME_TIME * FRAME_TIME);
                 break;
             }
-        }
 
-        // Move to the next opcode
-        count += paramCounts[chart[count]] + 1;
+            case EVENT_LYRIC:
+                state.lyric = chart[count].value;
+                break;
+
+            case EVENT_MUSIC:
+                state.musicTime = frame;
+                break;
+
+            case EVENT_FLYTIME:
+                state.flyTime = chart[count].value;
+                maxFlyTime = std::max(maxFlyTime, state.flyTime);
+                break;
+        }
     }
 
-    // Set the reference score, adjusted for combos below 50
-    scoreRef = score - 7250;
+    memoryTag(MEMORY_CHART, chart.capacity() * sizeof(ChartEvent) + checkpoints.capacity() * sizeof(Checkpoint));
 }
 
-static void updateChart()
+static HOT_CODE void updateChart()
 {
-    // Execute chart opcodes
-    while (counter < chartSize && !finished)
+    // Execute chart events
+    while (counter < chart.size() && !finished)
     {
-        switch (chart[counter])
+        ChartEvent &event = chart[counter];
+
+        switch (event.event)
         {
-            case 0x00: // End
+            case EVENT_END:
             {
                 // Indicate the chart has finished executing
                 finished = true;
                 return;
             }
 
-            case 0x01: // Time
+            case EVENT_TIME:
             {
                 // Stop execution until the target time is reached
-                if (timer < chart[counter + 1])
+                if (timer < event.value)
                     return;
                 break;
             }
 
-            case 0x06: // Target
+            case EVENT_NOTE:
             {
-                static Note note;
-                int32_t x = chart[counter + 2] * 256 / 480000 - 16;
-                int32_t y = chart[counter + 3] * 192 / 270000 - 16;
-
-                // Set the note type
-                if (chart[counter + 1] < 4) // Normal buttons
-                {
-                    note.type = chart[counter + 1];
-                }
-                else if (chart[counter + 1] < 8) // Held buttons
-                {
-                    // Mark held buttons with bit 4
-                    note.type = (chart[counter + 1] & 3) | BIT(4);
-                }
-                else if (chart[counter + 1] == 12 || chart[counter + 1] == 13) // Single slides
-                {
-                    // Mark single slides with bit 5
-                    note.type = (chart[counter + 1] - 8) | BIT(5);
-                }
-                else if (chart[counter + 1] == 15) // Left held slide
-                {
-                    // Mark all held slides with bit 6, and non-initial ones with bit 7
-                    uint8_t type = 4 | BIT(6);
-                    if (type == (note.type & ~BIT(7)) && x < note.x && y == note.y)
-                        type |= BIT(7);
-                    note.type = type;
-                }
-                else if (chart[counter + 1] == 16) // Right held slide
-                {
-                    // Mark all held slides with bit 6, and non-initial ones with bit 7
-                    uint8_t type = 5 | BIT(6);
-                    if (type == (note.type & ~BIT(7)) && x > note.x && y == note.y)
-                        type |= BIT(7);
-                    note.type = type;
-                }
-                else if (chart[counter + 1] >= 18 && chart[counter + 1] < 22) // Event notes
-                {
-                    // These normally trigger PV events; treat them as regular notes for now
-                    note.type = chart[counter + 1] - 18;
-                }
-                else
-                {
-                    break;
-                }
-
-                // Get the note angle and travel distance, scaled
-                float angle = (float)(int32_t)chart[counter + 4] * PI / 180000;
-                float distance = (float)chart[counter + 5] * 0x100 / 270000;
-
-                // Calculate the positional offset and per-frame increment
-                note.incX = (int)(sin(angle) *  distance);
-                note.incY = (int)(cos(angle) * -distance);
-                note.ofsX = note.incX * 60 * 3;
-                note.ofsY = note.incY * 60 * 3;
-                note.incX *= 100000.0f * 3 / flyTime;
-                note.incY *= 100000.0f * 3 / flyTime;
-
-                // Calculate the timing arrow per-frame increment
-                note.incArrow = ((float)DEGREES_IN_CIRCLE / 60) * 100000 / flyTime;
+                // Add a note to the queue, with increments scaled by the playback speed
+                // Frames advance less time when slowed down, so notes should move less each frame
+                Note note;
+                note.type = event.type;
+                note.x = event.x;
+                note.y = event.y;
+                note.ofsX = event.ofsX;
+                note.ofsY = event.ofsY;
+                note.incX = event.incX * speed / 100;
+                note.incY = event.incY * speed / 100;
+                note.incArrow = event.incArrow * speed / 100;
                 note.ofsArrow = 0;
-
-                // Add a note to the queue
-                note.x = x;
-                note.y = y;
                 note.time = timer + flyTime;
                 notes.push_back(note);
                 break;
             }
 
-            case 0x18: // Lyric
+            case EVENT_LYRIC:
             {
-                clearLyrics();
-                std::vector<std::string> &lyrics = songData[std::stoi(songName.substr(19, 3))].lyrics;
-
-                // Get a lyric from the song database and display it on the bottom screen
-                if (chart[counter + 1] < lyrics.size())
-                {
-                    std::string &lyric = lyrics[chart[counter + 1]];
-
-                    if (lyric.length() > 32)
-                    {
-                        // Split the lyric into two lines and draw them, centered
-                        size_t split = lyric.substr(0, 32).find_last_of(" ");
-                        size_t offset = (32 - split) / 2;
-                        printf("\x1b[10;%uH%s", offset, lyric.substr(0, split).c_str());
-                        offset = (32 - std::min(32U, lyric.length() - (split + 1))) / 2;
-                        printf("\x1b[12;%uH%s", offset, lyric.substr(split + 1, 32).c_str());
-                    }
-                    else
-                    {
-                        // Draw the lyric on one line, centered
-                        size_t offset = (32 - lyric.length()) / 2;
-                        printf("\x1b[11;%uH%s", offset, lyric.c_str());
-                    }
-                }
-
+                // Show a new lyric, unless seeking where only the last one matters
+                lyricIndex = event.value;
+                if (!seeking)
+                    drawLyric(lyricIndex);
                 break;
             }
 
-            case 0x19: // Music play
+            case EVENT_MUSIC:
             {
-                // Start playing the song
-                playSong(songName);
+                // Start playing the song, or remember when it started if seeking
+                musicTime = timer;
+                if (!seeking)
+                    playSong(songName);
                 break;
             }
 
-            case 0x1C: // Bar time set
+            case EVENT_FLYTIME:
             {
-                // Set the flying time using beats per minute and beats per bar
-                flyTime = (60.0f / chart[counter + 1]) * (chart[counter + 2] + 1) * 100000;
+                // Set the time between a note's creation and when it should be hit
+                flyTime = event.value;
                 break;
             }
 
-            case 0x3A: // Target flying time
+            case EVENT_EFFECT:
             {
-                // Set the time between a note's creation and when it should be hit
-                flyTime = chart[counter + 1] * 100;
+                // Play the chart sound effect
+                if (!seeking)
+                    playEffect(EFFECT_CHART);
                 break;
             }
         }
 
-        // Move to the next opcode
-        counter += paramCounts[chart[counter]] + 1;
+        // Move to the next event
+        counter++;
+    }
+}
+
+static uint32_t songOffset()
+{
+    // Get the position in the song that matches the chart timer, in bytes
+    return ((uint64_t)(timer - musicTime) * 44100 * 2 / 100000) & ~0x3;
+}
+
+static void seekChart(size_t index)
+{
+    // Start from a checkpoint early enough that every note pending at the target was already created
+    index = std::min(index, checkpoints.size() - 1);
+    size_t back = maxFlyTime / CHECKPOINT_TIME + 2;
+    size_t start = (index > back) ? (index - back) : 0;
+    Checkpoint &point = checkpoints[start];
+
+    // Restore the chart state from the checkpoint
+    closeSong();
+    notes.clear();
+    counter = point.counter;
+    flyTime = point.flyTime;
+    lyricIndex = point.lyric;
+    musicTime = point.musicTime;
+    timer = frameTime(start);
+    timerFrac = 0;
+    finished = false;
+    current = mask = mask2 = 0;
+    statTimer = 0;
+    holdNotes = holdStart = 0;
+    holdTime = holdScore = 0;
+    slideCount = 0;
+    slideBroken = false;
+    combo = 0;
+    life = 127;
+
+    // Run the chart up to the target frame without any output, moving notes like the game loop would
+    seeking = true;
+    while (timer < frameTime(index))
+    {
+        updateChart();
+        moveNotes();
+
+        // Drop notes that would have been missed
+        while (!notes.empty() && notes[0].time + FRAME_TIME * 12 < timer)
+            notes.pop_front();
+        advanceTimer();
+    }
+
+    seeking = false;
+
+    // Show the current lyric and play the song from the matching position
+    drawLyric(lyricIndex);
+    if (musicTime >= 0)
+        playSong(songName, songOffset());
+}
+
+static void saveSnapshot()
+{
+    Snapshot snap = {};
+    snap.magic = SNAPSHOT_MAGIC;
+    snap.version = SNAPSHOT_VERSION;
+    snprintf(snap.chartName, sizeof(snap.chartName), "%s", chartName.c_str());
+    snprintf(snap.songName, sizeof(snap.songName), "%s", songName.c_str());
+    snap.chartSize = chart.size();
+    snap.difficulty = chartDifficulty;
+
+    // Keep the song's table entry so its lyrics can be loaded without the database, along with the cache it points into
+    snap.song = songInfo;
+    snap.cacheStamp = cacheStamp();
+
+    // Copy the chart and judgement state
+    snap.counter = counter;
+    snap.timer = timer;
+    snap.timerFrac = timerFrac;
+    snap.flyTime = flyTime;
+    snap.lyricIndex = lyricIndex;
+    snap.musicTime = musicTime;
+    snap.audioOffset = (musicTime >= 0) ? songOffset() : 0;
+    snap.finished = finished;
+    snap.current = current;
+    snap.mask = mask;
+    snap.mask2 = mask2;
+    snap.holdNotes = holdNotes;
+    snap.holdStart = holdStart;
+    snap.slideBroken = slideBroken;
+    snap.life = life;
+    snap.holdTime = holdTime;
+    snap.holdScore = holdScore;
+    snap.slideCount = slideCount;
+    snap.combo = combo;
+    snap.scoreRef = scoreRef;
+    snap.speed = speed;
+    snap.practiceStart = practiceStart;
+    snap.practiceEnd = practiceEnd;
+    snap.results = results;
+    snap.noteCount = notes.size();
+
+    // Write the state followed by the queued notes
+    if (FILE *file = fopen(SNAPSHOT_PATH, "wb"))
+    {
+        fwrite(&snap, sizeof(snap), 1, file);
+        for (size_t i = 0; i < notes.size(); i++)
+            fwrite(&notes[i], sizeof(Note), 1, file);
+        fclose(file);
     }
 }
 
 void gameLoop()
 {
-    // Open the song list on start
-    songList();
+    // Open the song list on start, or the pause menu if a suspended session was restored
+    if (restored)
+        retryMenu(true);
+    else
+        songList();
+    frameCount = vblankCount;
 
     int32_t statX = 0, statY = 0;
     int32_t statCurX = 0, statCurY = 0;
@@ -460,8 +653,12 @@ void gameLoop()
     while (true)
     {
         // Update the song and chart
+        profileStart();
+        effectsFrame();
         updateSong();
+        profileMark(PROFILE_AUDIO);
         updateChart();
+        profileMark(PROFILE_CHART);
 
         oamClear(&oamMain, 0, 0);
         oamClear(&oamSub, 0, 0);
@@ -507,38 +704,17 @@ void gameLoop()
                             continue;
                         }
 
-                        // Miss if a wrong key is pressed
-                        statType = 4;
+                        // Miss if a wrong key is pressed, adjusting life and score by how close it was
+                        uint32_t offset = abs((int32_t)(notes[0].time - timer));
+                        JudgeRecord record = judgeWrongs[noteClass(notes[0].type)](offset);
+                        statType = record.judgement;
                         statTimer = 60;
                         statCurX = statX;
                         statCurY = statY;
-                        results.misses++;
+                        results.judgements[JUDGE_MISS]++;
                         combo = 0;
-
-                        // Check how precisely the note was hit and adjust life and score
-                        // For slides, fine/safe count as cool, and sad counts as fine
-                        // TODO: verify timings, add unique graphics
-                        int32_t offset = abs((int32_t)(notes[0].time - timer));
-                        if (offset <= FRAME_TIME * ((notes[0].type & 0xE0) ? 9 : 3)) // Wrong (red)
-                        {
-                            life = std::max(0, life - 3);
-                            results.scoreBase += 250;
-                        }
-                        else if (offset <= FRAME_TIME * 6 || (notes[0].type & 0xE0)) // Wrong (black)
-                        {
-                            life = std::max(0, life - 6);
-                            results.scoreBase += 150;
-                        }
-                        else if (offset <= FRAME_TIME * 9) // Wrong (green)
-                        {
-                            life = std::max(0, life - 9);
-                            results.scoreBase += 50;
-                        }
-                        else // Wrong (blue)
-                        {
-                            life = std::max(0, life - 15);
-                            results.scoreBase += 30;
-                        }
+                        life = std::max(0, life + record.life);
+                        results.scoreBase += record.score;
 
                         // Clear notes that were missed
                         for (; current > 0; current--)
@@ -562,8 +738,9 @@ void gameLoop()
                         // Adjust score for non-initial held slides, which are always cool
                         // A score bonus is added based on the current "combo" of these notes
                         // TODO: draw the score bonus UI
-                        results.scoreBase += 500;
+                        results.scoreBase += judgeHit<NOTE_HELD_SLIDE>(0).score;
                         results.scoreSlide += (++slideCount) * 10;
+                        playEffect(EFFECT_SLIDE, statX + 16);
 
                         // Detect the end of a held slide
                         if (notes.size() == current || !(notes[current].type & BIT(7)))
@@ -584,46 +761,25 @@ void gameLoop()
                     else
                     {
                         // Check how precisely the note was hit and adjust life and score
-                        // For slides, fine/safe count as cool, and sad counts as fine
-                        // TODO: verify timings
-                        int32_t offset = abs((int32_t)(notes[0].time - timer));
-                        if (offset <= FRAME_TIME * ((notes[0].type & 0xE0) ? 9 : 3)) // Cool
-                        {
-                            statType = 0;
-                            combo++;
-                            life = std::min(255, life + 2);
-                            results.scoreBase += 500 * current;
-                            results.cools++;
-
-                            // Add a 10-point bonus at full health
-                            if (life == 255)
-                                results.scoreBase += 10;
-                        }
-                        else if (offset <= FRAME_TIME * 6 || (notes[0].type & 0xE0)) // Fine
-                        {
-                            statType = 1;
+                        uint32_t offset = abs((int32_t)(notes[0].time - timer));
+                        JudgeRecord record = judgeHits[noteClass(notes[0].type)](offset);
+                        statType = record.judgement;
+                        results.judgements[record.judgement]++;
+                        life = std::min(255, std::max(0, life + record.life));
+                        results.scoreBase += record.score * current;
+
+                        // Keep the combo going on cool and fine, and break it otherwise
+                        if (record.judgement <= JUDGE_FINE)
                             combo++;
-                            life = std::min(255, life + 1);
-                            results.scoreBase += 300 * current;
-                            results.fines++;
-                        }
-                        else if (offset <= FRAME_TIME * 9) // Safe
-                        {
-                            statType = 2;
+                        else
                             combo = 0;
-                            results.scoreBase += 100 * current;
-                            results.safes++;
-                        }
-                        else // Sad
-                        {
-                            statType = 3;
-                            combo = 0;
-                            life = std::max(0, life - 10);
-                            results.scoreBase += 50 * current;
-                            results.sads++;
-                        }
 
-                        // Show the hit status above the note
+                        // Add a 10-point bonus at full health on cool
+                        if (record.judgement == JUDGE_COOL && life == 255)
+                            results.scoreBase += 10;
+
+                        // Play a hit sound and show the hit status above the note
+                        playEffect((notes[0].type & 0xE0) ? EFFECT_SLIDE : EFFECT_HIT, statX + 16);
                         statTimer = 60;
                         statCurX = statX;
                         statCurY = statY;
@@ -676,13 +832,13 @@ void gameLoop()
                     else
                     {
                         // Miss if a note wasn't cleared in time
-                        statType = 4;
+                        statType = JUDGE_MISS;
                         statTimer = 60;
                         statCurX = statX;
                         statCurY = statY;
                         combo = 0;
-                        life = std::max(0, life - 20);
-                        results.misses++;
+                        life = std::max(0, life + JUDGE_MISS_LIFE);
+                        results.judgements[JUDGE_MISS]++;
                     }
 
                     // Clear the notes that were missed
@@ -705,49 +861,9 @@ void gameLoop()
             }
         }
 
-        // Add score bonuses for note holds
-        // TODO: draw the score bonus UI
-        if (holdNotes)
-        {
-            if (holdStart == 12)
-            {
-                // Add a 10-point bonus per note hold every frame
-                for (int i = 0; i < 4; i++)
-                {
-                    if (holdNotes & BIT(i))
-                        results.scoreHold += 10;
-                }
-            }
-            else
-            {
-                // Queue a 10-point bonus per note hold every frame
-                for (int i = 0; i < 4; i++)
-                {
-                    if (holdNotes & BIT(i))
-                        holdScore += 10;
-                }
+        updateHolds();
 
-                // After 12 frames, commit to the hold and add the queued bonus
-                if (++holdStart == 12)
-                    results.scoreHold += holdScore;
-            }
-
-            if (++holdTime == 5 * 60) // 5 seconds
-            {
-                // Add a 1500-point bonus per note hold if the max hold time is reached
-                for (int i = 0; i < 4; i++)
-                {
-                    if (holdNotes & BIT(i))
-                        results.scoreHold += 1500;
-                }
-
-                // Cancel note holds after the max hold time is reached
-                holdNotes = 0;
-                holdStart = 0;
-                holdTime = 0;
-                holdScore = 0;
-            }
-        }
+        profileMark(PROFILE_INPUT);
 
         // Draw the hit status while its timer is active
         if (statTimer > 0)
@@ -778,12 +894,12 @@ void gameLoop()
             statTimer--;
         }
 
-        // Update all queued notes
+        // Draw all queued notes after moving them
+        moveNotes();
         for (size_t i = 0; i < notes.size(); i++)
         {
-            // Move the note closer to its hole
-            int x = notes[i].x + ((notes[i].ofsX -= notes[i].incX) >> 8);
-            int y = notes[i].y + ((notes[i].ofsY -= notes[i].incY) >> 8);
+            int x = notes[i].x + (notes[i].ofsX >> 8);
+            int y = notes[i].y + (notes[i].ofsY >> 8);
 
             // Draw the note if it's within screen bounds
             if (x > -32 && x < 256 && y > -32 && y < 192)
@@ -810,13 +926,10 @@ void gameLoop()
             }
             else
             {
-                // Move the timing arrow further along its rotation
-                uint16_t angle = (notes[i].ofsArrow -= notes[i].incArrow);
-
                 // Draw the timing arrow if rotscale objects are still available
                 if (rotscale < 32)
                 {
-                    oamRotateScale(&oamMain, rotscale, angle, intToFixed(1, 8), intToFixed(1, 8));
+                    oamRotateScale(&oamMain, rotscale, notes[i].ofsArrow, intToFixed(1, 8), intToFixed(1, 8));
                     oamSet(&oamMain, sprite++, notes[i].x, notes[i].y, 0, 1, SpriteSize_32x32,
                         SpriteColorFormat_Bmp, mainGfx[16], rotscale++, false, false, false, false, false);
                 }
@@ -859,6 +972,9 @@ void gameLoop()
                 SpriteColorFormat_Bmp, subGfx[1], 1, true, false, false, false, false);
         }
 
+        profileMark(PROFILE_SPRITES);
+        memoryTag(MEMORY_NOTES, notes.size() * sizeof(Note));
+
         // Update the maximum combo result
         if (combo > results.comboMax)
             results.comboMax = combo;
@@ -872,34 +988,78 @@ void gameLoop()
         printf("\x1b[0;25H%07lu", results.scoreBase + results.scoreHold + results.scoreSlide);
         printf("\x1b[23;0H%.02f%%", results.clear);
 
+        // Show the measured hit sound latency if testing it
+        if (getLatencyTest())
+        {
+            uint32_t average, maximum;
+            getLatency(average, maximum);
+            printf("\x1b[22;0HLatency %lu.%02lums avg %lu.%02lums max", average / 1000,
+                average % 1000 / 10, maximum / 1000, maximum % 1000 / 10);
+        }
+
         // Move to the next frame
+        profileDraw();
         oamUpdate(&oamMain);
         oamUpdate(&oamSub);
+        profileMark(PROFILE_OUTPUT);
         swiWaitForVBlank();
-        timer += FRAME_TIME;
+        profileEnd();
+        advanceTimer();
 
-        // Check the stop conditions
-        if (down & KEY_START)
+        // If the frame overran, step the chart through the VBlanks it missed so it stays in sync with the music
+        while (++frameCount != vblankCount)
+        {
+            updateChart();
+            moveNotes();
+            updateHolds();
+            advanceTimer();
+            results.skipped++;
+        }
+
+        // Check the stop conditions, suspending to the SD card when pausing or closing the lid
+        // Time spent outside the game loop is not counted as skipped frames
+        if (down & (KEY_START | KEY_LID))
         {
             clearLyrics();
+            saveSnapshot();
             retryMenu(true);
+            frameCount = vblankCount;
+        }
+        else if (practiceEnd && (life == 0 || timer >= practiceEnd || (finished && notes.empty())))
+        {
+            // Loop back to the start of the practice section instead of failing or showing results
+            seekChart(practiceStart);
+            frameCount = vblankCount;
         }
         else if (life == 0 || (finished && notes.empty()))
         {
             clearLyrics();
+            remove(SNAPSHOT_PATH);
+            profileSave(chartName.c_str());
             resultsScreen(&results, life == 0);
+            frameCount = vblankCount;
         }
     }
 }
 
 void gameReset()
 {
-    // Reset the current chart
+    // Discard the suspended session since the run it was from is over
+    remove(SNAPSHOT_PATH);
+
+    // Reset the current chart and its frame times
+    profileReset();
     notes.clear();
-    counter = 1;
+    counter = 0;
     timer = 0;
     flyTime = 100000;
     finished = false;
+    lyricIndex = -1;
+    musicTime = -1;
+    practiceEnd = 0;
+    timerFrac = 0;
+    speed = 100;
+    setSongSpeed(100);
     current = 0;
     mask = 0;
     mask2 = 0;
@@ -916,26 +1076,195 @@ void gameReset()
     processChart();
 }
 
-void loadChart(std::string &chartName, std::string &songName2, size_t difficulty, bool retry)
+void resyncSong()
+{
+    // Reopen the song at the chart position, so a lag change applies when it's resumed
+    if (musicTime >= 0)
+        cueSong(songName, songOffset());
+}
+
+size_t chartSeconds()
+{
+    // Get the length of the chart in whole seconds
+    return checkpoints.size() - 1;
+}
+
+void startPractice(size_t start, size_t end, int percent)
+{
+    // Restart the chart and loop a section of it, possibly slowed down
+    gameReset();
+    speed = percent;
+    setSongSpeed(percent);
+    practiceStart = start;
+    practiceEnd = frameTime(end);
+    seekChart(start);
+}
+
+static bool readChart(const std::string &name, std::vector<ChartEvent> &events)
 {
-    // Load a new chart file into memory
-    FILE *chartFile = fopen(chartName.c_str(), "rb");
-    fseek(chartFile, 0, SEEK_END);
-    chartSize = ftell(chartFile) / 4;
-    fseek(chartFile, 0, SEEK_SET);
-    if (chart) delete[] chart;
-    chart = new uint32_t[chartSize];
-    fread(chart, sizeof(uint32_t), chartSize, chartFile);
-    fclose(chartFile);
-
-    // Set the chart's song filename
+    // Read the DSC file, which may be packed, so a compiled chart can be checked against it
+    uint32_t base, size;
+    std::vector<uint32_t> dsc;
+    FILE *dscFile = openFile(name, base, size);
+    if (dscFile)
+    {
+        dsc.resize(size / 4);
+        dsc.resize(fread(dsc.data(), sizeof(uint32_t), dsc.size(), dscFile));
+        fclose(dscFile);
+    }
+
+    // Get the path of the compiled chart made by the converter
+    std::string noteName = name;
+    size_t folder = noteName.rfind("/dsc/");
+    if (folder != std::string::npos)
+        noteName.replace(folder, 5, "/note/");
+    noteName.replace(noteName.length() - 4, 4, ".bin");
+
+    // Load the compiled chart directly if it exists and was made from the current DSC file
+    if (FILE *noteFile = openFile(noteName, base, size))
+    {
+        ChartHeader header;
+        if (size >= sizeof(header) && fread(&header, sizeof(header), 1, noteFile) == 1 &&
+            header.magic == CHART_MAGIC && header.version == CHART_VERSION &&
+            header.count * sizeof(ChartEvent) <= size - sizeof(header) && (!dscFile ||
+            (header.sourceSize == dsc.size() * 4 && header.sourceCrc == chartCrc(dsc.data(), dsc.size()))))
+        {
+            events.resize(header.count);
+            if (fread(events.data(), sizeof(ChartEvent), header.count, noteFile) == header.count)
+            {
+                fclose(noteFile);
+                return true;
+            }
+        }
+        fclose(noteFile);
+    }
+
+    if (!dscFile)
+    {
+        events.clear();
+        return false;
+    }
+
+    // Fall back to compiling the DSC file in memory, which fails if its format isn't supported
+    return compileChart(dsc.data(), dsc.size(), events);
+}
+
+bool loadSnapshot()
+{
+    // Read a suspended session if there is one
+    FILE *file = fopen(SNAPSHOT_PATH, "rb");
+    if (!file) return false;
+    Snapshot snap;
+    bool valid = (fread(&snap, sizeof(snap), 1, file) == 1 && snap.magic == SNAPSHOT_MAGIC &&
+        snap.version == SNAPSHOT_VERSION && snap.difficulty < 5 && snap.noteCount < 0x1000);
+
+    // Read the queued notes
+    std::deque<Note> queue(valid ? snap.noteCount : 0);
+    for (size_t i = 0; i < queue.size() && valid; i++)
+        valid = (fread(&queue[i], sizeof(Note), 1, file) == 1);
+    fclose(file);
+
+    // Reload the chart, making sure it hasn't changed since the session was suspended
+    snap.chartName[sizeof(snap.chartName) - 1] = '\0';
+    snap.songName[sizeof(snap.songName) - 1] = '\0';
+    if (!valid || !readChart(snap.chartName, chart) || chart.size() != snap.chartSize)
+    {
+        remove(SNAPSHOT_PATH);
+        return false;
+    }
+    buildCheckpoints();
+
+    chartName = snap.chartName;
+    songName = snap.songName;
+    chartDifficulty = snap.difficulty;
+    static uint8_t divides[] = { 1, 2, 8, 20, 20 };
+    holdDivide = divides[chartDifficulty];
+    songInfo = snap.song;
+
+    // Only load lyrics if the database cache they point into hasn't been rebuilt since the session was suspended
+    if (snap.cacheStamp != cacheStamp())
+        songInfo.lyricCount = 0;
+    loadLyrics(songInfo);
+
+    // Restore the chart and judgement state
+    notes = queue;
+    counter = snap.counter;
+    timer = snap.timer;
+    timerFrac = snap.timerFrac;
+    flyTime = snap.flyTime;
+    lyricIndex = snap.lyricIndex;
+    musicTime = snap.musicTime;
+    finished = snap.finished;
+    current = snap.current;
+    mask = snap.mask;
+    mask2 = snap.mask2;
+    holdNotes = snap.holdNotes;
+    holdStart = snap.holdStart;
+    slideBroken = snap.slideBroken;
+    life = snap.life;
+    holdTime = snap.holdTime;
+    holdScore = snap.holdScore;
+    slideCount = snap.slideCount;
+    combo = snap.combo;
+    scoreRef = snap.scoreRef;
+    speed = snap.speed;
+    practiceStart = snap.practiceStart;
+    practiceEnd = snap.practiceEnd;
+    results = snap.results;
+    setSongSpeed(speed);
+
+    // Let the menus find the song later and apply its lag, then open the song at the suspended position so it can be resumed
+    menuResume(snap.song.id, chartDifficulty);
+    if (musicTime >= 0)
+        cueSong(songName, snap.audioOffset);
+    restored = true;
+    return true;
+}
+
+void prefetchChart(std::string &chartName2, std::string &songName2, int lagMs)
+{
+    // Read the next chart ahead of time, and fill the buffer of its song if it exists, so it can start right away
+    nextName = readChart(chartName2, nextChart) ? chartName2 : "";
+    if (fileExists(songName2))
+        primeSong(songName2, lagMs);
+}
+
+void loadChart(std::string &chartName2, std::string &songName2, size_t difficulty, bool retry)
+{
+    // Load a new chart into memory, using the compiled version if there is one, or the prefetched one if it matches
+    chartName = chartName2;
+    chartDifficulty = difficulty;
+    bool prefetched = (chartName == nextName);
+    if (prefetched)
+        chart.swap(nextChart);
+    std::vector<ChartEvent>().swap(nextChart);
+    nextName.clear();
+    if (!prefetched && !readChart(chartName, chart))
+    {
+        // Let the player pick something else if the chart can't be played
+        printf("\x1b[11;3HUnsupported chart format.");
+        for (int i = 0; i < 120; i++)
+            swiWaitForVBlank();
+        consoleClear();
+        songList();
+        return;
+    }
+    buildCheckpoints();
+
+    // Set the chart's song filename, and load only that song's lyrics
     songName = songName2;
+    songInfo = SongData();
+    if (SongData *song = findSong(std::stoi(songName.substr(19))))
+        songInfo = *song;
+    loadLyrics(songInfo);
 
     // Set the hold-score divider based on difficulty
     // The hold score is multiplied by 4 and divided by this for clear percent
     static uint8_t divides[] = { 1, 2, 8, 20, 20 };
     holdDivide = divides[difficulty];
 
+    memoryLog("game");
+
     // Show the retry menu if requested
     if (retry)
         retryMenu();
@@ -23,27 +23,33 @@
 #include <cstdint>
 #include <string>
 
+#include "judge.h"
+
 struct Results
 {
     float clear = 0;
     uint32_t total = 0;
-    uint32_t cools = 0;
-    uint32_t fines = 0;
-    uint32_t safes = 0;
-    uint32_t sads = 0;
-    uint32_t misses = 0;
+    uint32_t judgements[JUDGE_COUNT] = {};
     uint32_t comboMax = 0;
     uint32_t scoreBase = 0;
     uint32_t scoreHold = 0;
     uint32_t scoreSlide = 0;
+    uint32_t skipped = 0;
 };
 
 extern uint16_t *initObjBitmap(OamState *oam, const unsigned int *bitmap, size_t bitmapLen, SpriteSize size);
 
 extern void gameInit();
+extern uint32_t getVBlanks();
 extern void gameLoop();
 extern void gameReset();
 
+extern void resyncSong();
+extern size_t chartSeconds();
+extern void startPractice(size_t start, size_t end, int percent);
+
+extern bool loadSnapshot();
+extern void prefetchChart(std::string &chartName, std::string &songName, int lagMs);
 extern void loadChart(std::string &chartName, std::string &songName, size_t difficulty, bool retry);
 
 #endif // GAME_H
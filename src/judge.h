@@ -0,0 +1,156 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef JUDGE_H
+#define JUDGE_H
+
+#include <cstdint>
+
+#define FRAME_TIME 1672
+
+enum NoteClass
+{
+    NOTE_NORMAL,
+    NOTE_HOLD,
+    NOTE_SLIDE,     // Slides and double notes, which are judged more leniently
+    NOTE_HELD_SLIDE // Non-initial parts of a held slide, which are always cool
+};
+
+// Judgements in the order of their hit status graphics and result counts
+enum Judgement
+{
+    JUDGE_COOL,
+    JUDGE_FINE,
+    JUDGE_SAFE,
+    JUDGE_SAD,
+    JUDGE_MISS,
+    JUDGE_COUNT
+};
+
+// The outcome of judging a note, and how it changes life and score
+struct JudgeRecord
+{
+    uint8_t judgement;
+    int8_t life;
+    uint16_t score;
+};
+
+// Timing windows and rewards for a class of notes
+// Wrong keys are ranked by the same windows, but always count as a miss
+// TODO: verify timings, add unique graphics for wrong keys
+struct JudgeTable
+{
+    uint32_t windows[3]; // Largest offsets for cool, fine, and safe
+    uint16_t hitScores[4];
+    int8_t hitLives[4];
+    uint16_t wrongScores[4];
+    int8_t wrongLives[4];
+};
+
+constexpr JudgeTable judgeTables[] =
+{
+    { // Normal
+        { FRAME_TIME * 3, FRAME_TIME * 6, FRAME_TIME * 9 },
+        { 500, 300, 100, 50 }, { 2, 1, 0, -10 },
+        { 250, 150, 50, 30 }, { -3, -6, -9, -15 }
+    },
+    { // Hold
+        { FRAME_TIME * 3, FRAME_TIME * 6, FRAME_TIME * 9 },
+        { 500, 300, 100, 50 }, { 2, 1, 0, -10 },
+        { 250, 150, 50, 30 }, { -3, -6, -9, -15 }
+    },
+    { // Slide; fine/safe count as cool, and sad counts as fine
+        { FRAME_TIME * 9, UINT32_MAX, UINT32_MAX },
+        { 500, 300, 100, 50 }, { 2, 1, 0, -10 },
+        { 250, 150, 50, 30 }, { -3, -6, -9, -15 }
+    },
+    { // Held slide; only the cool entries are used
+        { UINT32_MAX, UINT32_MAX, UINT32_MAX },
+        { 500, 0, 0, 0 }, { 0, 0, 0, 0 },
+        { 0, 0, 0, 0 }, { 0, 0, 0, 0 }
+    }
+};
+
+#define JUDGE_MISS_LIFE -20
+
+inline NoteClass noteClass(uint8_t type)
+{
+    // Classify a note from its type bits
+    if (type & (1 << 7))
+        return NOTE_HELD_SLIDE;
+    if (type & 0x60)
+        return NOTE_SLIDE;
+    if (type & (1 << 4))
+        return NOTE_HOLD;
+    return NOTE_NORMAL;
+}
+
+template <NoteClass C>
+inline uint8_t judgeRank(uint32_t offset)
+{
+    // Count the windows an offset falls outside of, without branching
+    constexpr const JudgeTable &table = judgeTables[C];
+    return (offset > table.windows[0]) + (offset > table.windows[1]) + (offset > table.windows[2]);
+}
+
+template <NoteClass C>
+inline JudgeRecord judgeHit(uint32_t offset)
+{
+    // Judge a correct key press by how far it was from the note's time
+    constexpr const JudgeTable &table = judgeTables[C];
+    uint8_t rank = judgeRank<C>(offset);
+    return { rank, table.hitLives[rank], table.hitScores[rank] };
+}
+
+template <>
+inline JudgeRecord judgeHit<NOTE_HELD_SLIDE>(uint32_t)
+{
+    // Held slides only need to be held in time, so they're always cool
+    return { JUDGE_COOL, judgeTables[NOTE_HELD_SLIDE].hitLives[0], judgeTables[NOTE_HELD_SLIDE].hitScores[0] };
+}
+
+template <NoteClass C>
+inline JudgeRecord judgeWrong(uint32_t offset)
+{
+    // Judge a wrong key press, which still scores a little if it was close to the note's time
+    constexpr const JudgeTable &table = judgeTables[C];
+    uint8_t rank = judgeRank<C>(offset);
+    return { JUDGE_MISS, table.wrongLives[rank], table.wrongScores[rank] };
+}
+
+typedef JudgeRecord (*JudgeFunc)(uint32_t offset);
+
+// Judgement functions for each note class, so the game loop can dispatch on a note's type
+constexpr JudgeFunc judgeHits[] =
+{
+    judgeHit<NOTE_NORMAL>,
+    judgeHit<NOTE_HOLD>,
+    judgeHit<NOTE_SLIDE>,
+    judgeHit<NOTE_HELD_SLIDE>
+};
+
+constexpr JudgeFunc judgeWrongs[] =
+{
+    judgeWrong<NOTE_NORMAL>,
+    judgeWrong<NOTE_HOLD>,
+    judgeWrong<NOTE_SLIDE>,
+    judgeWrong<NOTE_HELD_SLIDE>
+};
+
+#endif // JUDGE_H
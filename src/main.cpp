@@ -24,8 +24,10 @@
 
 #include "audio.h"
 #include "database.h"
+#include "effects.h"
 #include "game.h"
 #include "menu.h"
+#include "pack.h"
 
 int main()
 {
@@ -60,9 +62,16 @@ int main()
 
     // Initialize the game
     audioInit();
-    databaseInit();
+    packInit();
+    effectsInit();
     gameInit();
-    menuInit();
+
+    // Restore a suspended session, or scan for songs and charts if there isn't one
+    if (!loadSnapshot())
+    {
+        databaseInit();
+        menuInit();
+    }
 
     // Run the game
     gameLoop();
@@ -18,8 +18,10 @@
 */
 
 #include <algorithm>
+#include <cstring>
 #include <dirent.h>
 #include <vector>
+#include <sys/stat.h>
 
 #include <nds.h>
 
@@ -33,8 +35,13 @@
 
 #include "menu.h"
 #include "audio.h"
+#include "chart.h"
 #include "database.h"
+#include "debug.h"
+#include "effects.h"
 #include "game.h"
+#include "judge.h"
+#include "pack.h"
 
 static const char a[] = {' ', '>'};
 
@@ -47,82 +54,369 @@ static const std::string ends[] =
     "_extreme_1.dsc"
 };
 
+struct RowText
+{
+    char lines[2][32];
+};
+
+// Header of the chart index, which lists the song ID and difficulty of every chart file name in the folder
+// It's stamped with the folder's modification time and entry count, which still means reading every entry name
+// on boot, but not opening or parsing any files. A chart replaced under the same name keeps its entry, which is
+// fine since the index only holds names; compiled charts check their own DSC's CRC when loaded.
+struct IndexHeader
+{
+    uint32_t magic;
+    uint32_t mtime;
+    uint32_t files;
+    uint32_t count;
+};
+
+#define INDEX_MAGIC 0x49534450 // "PDSI"
+
+// Header at the start of the lag file, followed by the per-song offsets
+struct LagHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    int32_t lag;
+    uint32_t count;
+};
+
+// An offset in milliseconds that's added to the lag config for one song
+struct SongLag
+{
+    uint16_t id;
+    int16_t ms;
+};
+
+// A chart queued to be played after the current one
+struct QueuedChart
+{
+    uint16_t id;
+    uint16_t difficulty;
+};
+
+#define LAG_MAGIC 0x474C4450 // "PDLG"
+#define LAG_VERSION 1
+#define LAG_PATH "/project-ds/lag.bin"
+
+// Lag calibration plays a metronome, with a few beats to get into time before taps are counted
+#define CALIBRATE_BPM 120
+#define CALIBRATE_LEAD 4
+#define CALIBRATE_TAPS 16
+
+enum SortMode
+{
+    SORT_NAME = 0,
+    SORT_LEVEL,
+    SORT_DENSITY,
+    SORT_NOTES,
+    SORT_COUNT
+};
+
+// Scanlines per frame that background conversion can use while the song list is idle
+#define CONVERT_LINES 200
+
+enum AudioStatus
+{
+    STATUS_UNKNOWN = 0,
+    STATUS_READY,
+    STATUS_QUEUED,
+    STATUS_MISSING
+};
+
 static uint16_t *menuGfx[10];
 
-static std::vector<std::string> charts[5];
+static std::vector<uint16_t> orders[SORT_COUNT][5];
+static std::vector<uint16_t> *charts = orders[SORT_NAME];
+static uint8_t sortMode = SORT_NAME;
+static std::vector<ChartMetrics> metrics;
+static std::vector<RowText> rowCache[5];
+static std::vector<uint8_t> audioStatus;
+static std::vector<uint16_t> convertQueue;
+static int convertProgress = -1;
 static size_t difficulty = 1;
 static size_t selection = 0;
 static int lagConfigMs = 0;
+static std::vector<SongLag> songLags;
+static uint16_t songId = 0;
+static bool lagLoaded = false;
+static bool lagChanged = false;
+static std::vector<QueuedChart> playlist;
+static size_t practiceA = 0;
+static size_t practiceB = 0;
+static int practiceSpeed = 100;
 
 static int bg = 0;
 static uint16_t bgLine = 0;
 
+static bool menuLoaded = false;
+static uint16_t resumeId = 0;
+static uint16_t playingId = 0;
+
+static std::string songPath(const char *folder, uint16_t id, const std::string &end)
+{
+    // Build the path to a song file from its ID
+    char path[64];
+    sprintf(path, "/project-ds/%s/pv_%03u", folder, id);
+    return path + end;
+}
+
+static ChartMetrics *findMetrics(uint16_t id, size_t diff)
+{
+    // Look up a chart's entry in the metrics index, which is sorted by difficulty and then ID
+    auto it = std::lower_bound(metrics.begin(), metrics.end(), (diff << 16) | id,
+        [](const ChartMetrics &m, size_t key) { return ((size_t)m.difficulty << 16 | m.id) < key; });
+    return (it != metrics.end() && it->id == id && it->difficulty == diff) ? &*it : nullptr;
+}
+
+static void loadLag()
+{
+    // Load the lag config and per-song offsets if they haven't been already
+    if (lagLoaded) return;
+    lagLoaded = true;
+    FILE *file = fopen(LAG_PATH, "rb");
+    if (!file) return;
+
+    LagHeader header;
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == LAG_MAGIC && header.version == LAG_VERSION)
+    {
+        lagConfigMs = std::min(1000, std::max(-1000, (int)header.lag));
+        songLags.resize(std::min<uint32_t>(header.count, 0x10000));
+        songLags.resize(fread(songLags.data(), sizeof(SongLag), songLags.size(), file));
+    }
+    fclose(file);
+}
+
+static void saveLag()
+{
+    // Write the lag config and per-song offsets, dropping songs that are back to no offset
+    lagChanged = false;
+    songLags.erase(std::remove_if(songLags.begin(), songLags.end(),
+        [](const SongLag &entry) { return entry.ms == 0; }), songLags.end());
+
+    if (FILE *file = fopen(LAG_PATH, "wb"))
+    {
+        LagHeader header = { LAG_MAGIC, LAG_VERSION, lagConfigMs, songLags.size() };
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(songLags.data(), sizeof(SongLag), songLags.size(), file);
+        fclose(file);
+    }
+}
+
+static int getSongLag(uint16_t id)
+{
+    // Get a song's offset, which is zero unless one was set
+    for (size_t i = 0; i < songLags.size(); i++)
+        if (songLags[i].id == id)
+            return songLags[i].ms;
+    return 0;
+}
+
+static void setSongLag(uint16_t id, int ms)
+{
+    // Set a song's offset, adding an entry for it if there isn't one
+    for (size_t i = 0; i < songLags.size(); i++)
+    {
+        if (songLags[i].id == id)
+        {
+            songLags[i].ms = ms;
+            return;
+        }
+    }
+    songLags.push_back({ id, (int16_t)ms });
+}
+
+static void applyLag(uint16_t id)
+{
+    // Use the lag config along with the song's own offset for the current song
+    songId = id;
+    setLagConfig(lagConfigMs + getSongLag(id));
+}
+
+static bool calibrateLag()
+{
+    consoleClear();
+    printf("\x1b[6;8HLag Calibration");
+    printf("\x1b[8;5HPress A on every beat");
+    printf("\x1b[9;5HPress B to cancel");
+    printf("\x1b[11;5HTaps  0/%u", CALIBRATE_TAPS);
+
+    // Play a metronome through the song stream, so the measurement includes its latency
+    std::vector<int32_t> offsets;
+    uint32_t beat = 60 * 100000 / CALIBRATE_BPM;
+    uint32_t timer = 0;
+    playMetronome(CALIBRATE_BPM);
+
+    // Record how far each tap is from the nearest beat, timing frames the same way as the game loop
+    while (offsets.size() < CALIBRATE_TAPS)
+    {
+        updateSong();
+        scanKeys();
+        uint16_t down = keysDown();
+        if (down & KEY_B)
+            break;
+
+        uint32_t nearest = (timer + beat / 2) / beat * beat;
+        if ((down & KEY_A) && nearest >= beat * CALIBRATE_LEAD)
+        {
+            offsets.push_back(timer - nearest);
+            printf("\x1b[11;5HTaps %2u/%u %+5ldms", offsets.size(), CALIBRATE_TAPS, offsets.back() / 100);
+        }
+
+        swiWaitForVBlank();
+        timer += FRAME_TIME;
+    }
+
+    stopMetronome();
+    if (offsets.size() < CALIBRATE_TAPS)
+    {
+        consoleClear();
+        return false;
+    }
+
+    // Estimate the offset with the median and the mean of the middle half, which both ignore stray taps
+    std::sort(offsets.begin(), offsets.end());
+    int32_t median = (offsets[CALIBRATE_TAPS / 2 - 1] + offsets[CALIBRATE_TAPS / 2]) / 2;
+    int32_t sum = 0;
+    for (size_t i = CALIBRATE_TAPS / 4; i < CALIBRATE_TAPS * 3 / 4; i++)
+        sum += offsets[i];
+    int32_t mean = sum / (CALIBRATE_TAPS / 2);
+
+    // Shift the song against the trimmed mean, which unlike the median isn't limited to whole frames
+    lagConfigMs = std::min(1000, std::max(-1000, (int)(-mean / 100)));
+    lagChanged = true;
+    applyLag(songId);
+
+    printf("\x1b[13;5HMedian       %+5ldms", median / 100);
+    printf("\x1b[14;5HTrimmed mean %+5ldms", mean / 100);
+    printf("\x1b[16;5HLag config set to %d", lagConfigMs);
+    printf("\x1b[18;5HPress A to continue");
+
+    // Wait for the A button to be pressed
+    uint16_t down = 0;
+    keysDown();
+    while (!(down & KEY_A))
+    {
+        scanKeys();
+        down = keysDown();
+        swiWaitForVBlank();
+    }
+
+    consoleClear();
+    return true;
+}
+
 static void sortSongs()
 {
-    // Toggle between alphabetical and difficulty level sorting
-    static bool mode = false;
-    mode = !mode;
+    // Define a table of custom character priorities for sorting
+    // Letter cases are equal, and numbers come after letters
+    static const uint8_t prios[0x80] =
+    {
+         0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x00-0x0F
+         0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x10-0x1F
+         0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x20-0x2F
+        28, 29, 30, 31, 32, 33, 34, 35, 36, 37,  0,  0,  0,  0,  0,  0, // 0x30-0x3F
+         0,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, // 0x40-0x4F
+        17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,  0,  0,  0,  0,  0, // 0x50-0x5F
+         0,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, // 0x60-0x6F
+        17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,  0,  0,  0,  0,  0, // 0x70-0x7F
+    };
 
-    // Sort the songs in each difficulty tab
+    // Build a collation key for each song name from character priorities
+    // Leading characters that aren't letters or numbers are ignored
+    std::vector<std::string> keys(songData.size());
+    for (size_t i = 0; i < songData.size(); i++)
+    {
+        const char *name = getSongName(songData[i]);
+        while (*name && !prios[*name & 0x7F])
+            name++;
+        for (; *name; name++)
+            keys[i] += (char)prios[*name & 0x7F];
+    }
+
+    // Rank all songs alphabetically once, so sorting only has to compare numbers
+    std::vector<uint16_t> names(songData.size());
+    std::vector<uint16_t> ranks(songData.size());
+    for (size_t i = 0; i < names.size(); i++)
+        names[i] = i;
+    std::stable_sort(names.begin(), names.end(), [&keys](uint16_t a, uint16_t b) { return keys[a] < keys[b]; });
+    for (size_t i = 0; i < names.size(); i++)
+        ranks[names[i]] = i;
+
+    // Build every ordering of the songs in each difficulty tab
     for (int i = 0; i < 5; i++)
     {
-        sort(charts[i].begin(), charts[i].end(), [i](std::string &a, std::string &b)
+        std::vector<uint64_t> sorts[SORT_COUNT];
+        for (size_t j = 0; j < orders[SORT_NAME][i].size(); j++)
         {
-            uint8_t diffA = (songData[std::stoi(a)].difficulty >> (i * 5)) & 0x1F;
-            uint8_t diffB = (songData[std::stoi(b)].difficulty >> (i * 5)) & 0x1F;
+            // Pack the sort keys and song ID together so each ordering is a plain integer sort
+            // Charts missing from the metrics index are placed after the rest
+            SongData &song = *findSong(orders[SORT_NAME][i][j]);
+            ChartMetrics *chart = findMetrics(song.id, i);
+            uint64_t rank = ranks[&song - &songData[0]];
+            uint64_t diff = (song.difficulty >> (i * 5)) & 0x1F;
+            uint64_t density = chart ? chart->peakDensity : 0x10000;
+            uint64_t notes = chart ? chart->notes : 0x10000;
+            sorts[SORT_NAME].push_back((rank << 16) | song.id);
+            sorts[SORT_LEVEL].push_back((diff << 32) | (rank << 16) | song.id);
+            sorts[SORT_DENSITY].push_back((density << 32) | (rank << 16) | song.id);
+            sorts[SORT_NOTES].push_back((notes << 32) | (rank << 16) | song.id);
+        }
 
-            // Sort alphabetically in alphabetical mode, or as a fallback if difficulties match
-            if (mode || diffA == diffB)
-            {
-                std::string &nameA = songData[std::stoi(a)].name;
-                std::string &nameB = songData[std::stoi(b)].name;
-                size_t j = 0, k = 0;
+        // Sort alphabetically, or by difficulty level, note density, or note count with alphabetical as a fallback
+        for (int k = 0; k < SORT_COUNT; k++)
+        {
+            std::sort(sorts[k].begin(), sorts[k].end());
+            orders[k][i].resize(sorts[k].size());
+            for (size_t j = 0; j < sorts[k].size(); j++)
+                orders[k][i][j] = sorts[k][j] & 0xFFFF;
+        }
+    }
+}
 
-                // Define a table of custom character priorities for sorting
-                // Letter cases are equal, and numbers come after letters
-                static uint8_t prios[0x80] =
-                {
-                     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x00-0x0F
-                     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x10-0x1F
-                     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, // 0x20-0x2F
-                    28, 29, 30, 31, 32, 33, 34, 35, 36, 37,  0,  0,  0,  0,  0,  0, // 0x30-0x3F
-                     0,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, // 0x40-0x4F
-                    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,  0,  0,  0,  0,  0, // 0x50-0x5F
-                     0,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15, 16, // 0x60-0x6F
-                    17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,  0,  0,  0,  0,  0, // 0x70-0x7F
-                };
-
-                // Ignore leading characters that aren't letters or numbers in the first string
-                while (!prios[(uint8_t)nameA[j]])
-                    if (++j == nameA.length())
-                        return true;
-
-                // Ignore leading characters that aren't letters or numbers in the second string
-                while (!prios[(uint8_t)nameB[k]])
-                    if (++k == nameB.length())
-                        return false;
-
-                while (true)
-                {
-                    // Search the strings until a non-matching priority is found
-                    if (prios[(uint8_t)nameA[j]] == prios[(uint8_t)nameB[k]])
-                    {
-                        if (++j == nameA.length())
-                            return true;
-                        if (++k == nameB.length())
-                            return false;
-                        continue;
-                    }
-
-                    // Sort the songs based on the first non-matching character priority
-                    return prios[(uint8_t)nameA[j]] < prios[(uint8_t)nameB[k]];
-                }
-            }
+static RowText &getRow(uint16_t id)
+{
+    SongData &data = *findSong(id);
+    RowText &row = rowCache[difficulty][&data - &songData[0]];
 
-            // Sort the songs based on difficulty level
-            return diffA < diffB;
-        });
+    // Format the song's list item text for the current difficulty the first time it's shown
+    if (!row.lines[0][0])
+    {
+        static const char *ranks[5] = { "", "(S)", "(G)", "(E)", "(P)" };
+        snprintf(row.lines[0], 32, "%-26.26s %4.1f", getSongName(data),
+            ((float)((data.difficulty >> (difficulty * 5)) & 0x1F)) / 2);
+
+        // Show the measurement the songs are sorted by in place of the star level
+        ChartMetrics *chart = findMetrics(id, difficulty);
+        if (sortMode == SORT_DENSITY)
+            snprintf(&row.lines[0][27], 5, chart ? "%2d/s" : "   ?", std::min(99, chart ? (int)chart->peakDensity : 0));
+        else if (sortMode == SORT_NOTES)
+            snprintf(&row.lines[0][27], 5, chart ? "%4d" : "   ?", chart ? (int)chart->notes : 0);
+
+        // Show the song's conversion status in the free space before its score
+        char status[11] = "";
+        if (audioStatus[&data - &songData[0]] == STATUS_MISSING)
+            sprintf(status, "No audio");
+        else if (audioStatus[&data - &songData[0]] == STATUS_QUEUED && convertProgress >= 0 && convertQueue[0] == id)
+            sprintf(status, "Conv %2d%%", convertProgress);
+        else if (audioStatus[&data - &songData[0]] == STATUS_QUEUED)
+            sprintf(status, "Queued");
+
+        snprintf(row.lines[1], 32, "%-10s%07lupt %6.2f%% %-3s", status, data.scores[difficulty],
+            data.clears[difficulty], ranks[data.ranks[difficulty]]);
     }
+
+    return row;
+}
+
+static void drawRow(size_t i, size_t offset)
+{
+    // Draw a list item over its full width, shifted right if it's selected
+    RowText &row = getRow(charts[difficulty][i]);
+    bool selected = (i == selection);
+    for (int j = 0; j < 2; j++)
+        printf("\x1b[30m\x1b[%d;0H%s%s%s", (i - offset) * 3 + 1 + j, selected ? " " : "", row.lines[j], selected ? "" : " ");
 }
 
 static void bgHBlank()
@@ -145,32 +439,306 @@ static void bgHBlank()
     }
 }
 
-void menuInit()
+static void clearRow(uint16_t id)
 {
-    // Scan chart files (.dsc) and build song ID lists for each difficulty
-    if (DIR *dir = opendir("/project-ds/dsc"))
+    // Clear a song's cached list item text in every tab
+    size_t index = findSong(id) - &songData[0];
+    for (int i = 0; i < 5; i++)
+        if (!rowCache[i].empty())
+            rowCache[i][index].lines[0][0] = '\0';
+}
+
+static void refreshRow(uint16_t id, size_t offset)
+{
+    // Update a song's list item text, and redraw it if it's visible
+    clearRow(id);
+    for (size_t i = offset; i < offset + std::min(charts[difficulty].size(), 7U); i++)
+        if (charts[difficulty][i] == id)
+            drawRow(i, offset);
+}
+
+static void stopConversion()
+{
+    // Pause the background conversion job so it can be resumed from a checkpoint later
+    if (convertProgress >= 0)
+    {
+        convertPause();
+        convertProgress = -1;
+    }
+}
+
+static uint32_t lineCount()
+{
+    // Count scanlines without wrapping, from the VBlank count and the lines since the last VBlank started
+    return getVBlanks() * 263 + (REG_VCOUNT + 263 - 192) % 263;
+}
+
+static void convertIdle(size_t offset)
+{
+    // Check the audio status of the selected song first, then the other visible songs, one per frame
+    for (size_t i = 0; i <= std::min(charts[difficulty].size(), 7U); i++)
     {
-        while (dirent *entry = readdir(dir))
+        uint16_t id = charts[difficulty][i ? (offset + i - 1) : selection];
+        uint8_t &status = audioStatus[findSong(id) - &songData[0]];
+        if (status != STATUS_UNKNOWN)
+            continue;
+
+        // Queue songs that have an OGG file but haven't been converted yet
+        if (fileExists(songPath("pcm", id, ".pcm")))
         {
-            std::string name = entry->d_name;
-            if (name.length() > 6 && name.substr(0, 3) == "pv_" && name[3] >= '0' && name[3] <= '9' &&
-                name[4] >= '0' && name[4] <= '9' && name[5] >= '0' && name[5] <= '9')
-            {
-                for (int i = 0; i < 5; i++)
-                {
-                    if (name.substr(6) == ends[i])
-                    {
-                        charts[i].push_back(name.substr(3, 3));
-                        break;
-                    }
-                }
-            }
+            status = STATUS_READY;
+            return;
+        }
+        else if (fileExists(songPath("ogg", id, ".ogg")))
+        {
+            status = STATUS_QUEUED;
+            convertQueue.push_back(id);
+        }
+        else
+        {
+            status = STATUS_MISSING;
+        }
+
+        refreshRow(id, offset);
+        return;
+    }
+
+    if (convertQueue.empty())
+        return;
+
+    // Move the selected song to the front of the queue so it's converted next
+    uint16_t id = charts[difficulty][selection];
+    auto it = std::find(convertQueue.begin(), convertQueue.end(), id);
+    if (it != convertQueue.end() && it != convertQueue.begin())
+    {
+        uint16_t front = convertQueue[0];
+        stopConversion();
+        convertQueue.erase(it);
+        convertQueue.insert(convertQueue.begin(), id);
+        refreshRow(front, offset);
+    }
+
+    // Start or resume a job for the song at the front of the queue
+    id = convertQueue[0];
+    if (convertProgress < 0)
+    {
+        std::string oggName = songPath("ogg", id, ".ogg");
+        std::string pcmName = songPath("pcm", id, ".pcm");
+        if (!convertStart(oggName, pcmName))
+        {
+            audioStatus[findSong(id) - &songData[0]] = STATUS_MISSING;
+            convertQueue.erase(convertQueue.begin());
+            refreshRow(id, offset);
+            return;
         }
 
+        convertProgress = 0;
+    }
+
+    // Decode for most of the frame, one packet at a time
+    int progress = convertProgress;
+    uint32_t start = lineCount();
+    while (progress >= 0 && progress < 100 && lineCount() - start < CONVERT_LINES)
+        progress = convertStep();
+
+    if (progress < 0 || progress == 100)
+    {
+        // Finish the job and move on to the next song
+        audioStatus[findSong(id) - &songData[0]] = (progress == 100) ? STATUS_READY : STATUS_MISSING;
+        convertQueue.erase(convertQueue.begin());
+        convertProgress = -1;
+        refreshRow(id, offset);
+    }
+    else if (progress != convertProgress)
+    {
+        // Update the shown progress
+        convertProgress = progress;
+        refreshRow(id, offset);
+    }
+}
+
+static uint32_t countFiles()
+{
+    // Count the entries in the chart folder, since FAT doesn't update a folder's modification time when files are added
+    uint32_t files = 0;
+    if (DIR *dir = opendir("/project-ds/dsc"))
+    {
+        while (readdir(dir))
+            files++;
         closedir(dir);
     }
+    return files;
+}
+
+static bool loadIndex(uint32_t mtime, uint32_t files)
+{
+    // Load the chart index if it exists and the chart folder hasn't changed since it was written
+    FILE *file = fopen("/project-ds/dsc.idx", "rb");
+    if (!file) return false;
+    IndexHeader header;
+    if (!mtime || fread(&header, sizeof(header), 1, file) != 1 || header.magic != INDEX_MAGIC ||
+        header.mtime != mtime || header.files != files || header.count > 5 * 0x10000)
+    {
+        fclose(file);
+        return false;
+    }
+
+    // Read all the entries in one go
+    std::vector<uint32_t> entries(header.count);
+    bool valid = (fread(entries.data(), sizeof(uint32_t), header.count, file) == header.count);
+    fclose(file);
+    if (!valid) return false;
+
+    // Add the indexed charts to the song ID lists, with the difficulty in the upper bits
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        uint16_t id = entries[i];
+        uint8_t diff = entries[i] >> 16;
+        if (diff < 5)
+            orders[0][diff].push_back(addSong(id).id);
+    }
+
+    return true;
+}
+
+static void writeIndex(uint32_t mtime, uint32_t files)
+{
+    // Collect the chart entries from the song ID lists
+    std::vector<uint32_t> entries;
+    for (int i = 0; i < 5; i++)
+        for (size_t j = 0; j < orders[0][i].size(); j++)
+            entries.push_back((i << 16) | orders[0][i][j]);
+
+    // Write the chart index, stamped with the folder's modification time and file count
+    if (FILE *file = fopen("/project-ds/dsc.idx", "wb"))
+    {
+        IndexHeader header;
+        header.magic = INDEX_MAGIC;
+        header.mtime = mtime;
+        header.files = files;
+        header.count = entries.size();
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(entries.data(), sizeof(uint32_t), entries.size(), file);
+        fclose(file);
+    }
+}
+
+static void addChart(const std::string &name)
+{
+    // Check that a chart filename matches the expected format
+    if (name.length() <= 6 || name.substr(0, 3) != "pv_")
+        return;
+
+    // Find the end of the song ID, which has at least 3 digits
+    size_t end = 3;
+    while (end < name.length() && name[end] >= '0' && name[end] <= '9')
+        end++;
+    if (end < 6 || end > 8 || (end > 6 && name[3] == '0'))
+        return;
+
+    for (int i = 0; i < 5; i++)
+    {
+        if (name.substr(end) == ends[i])
+        {
+            // Add the chart, and make sure its song has an entry in the table
+            int id = std::stoi(name.substr(3, end - 3));
+            if (id > 0xFFFF)
+                return;
+            orders[0][i].push_back(addSong(id).id);
+            return;
+        }
+    }
+}
+
+static void loadCharts()
+{
+    for (int i = 0; i < SORT_COUNT; i++)
+        for (int j = 0; j < 5; j++)
+            orders[i][j].clear();
+
+    // Load the chart metrics made by the converter in one read, if they exist
+    metrics.clear();
+    uint32_t base, size;
+    if (FILE *file = openFile("/project-ds/metrics.bin", base, size))
+    {
+        MetricsHeader header;
+        if (size >= sizeof(header) && fread(&header, sizeof(header), 1, file) == 1 && header.magic == METRICS_MAGIC &&
+            header.version == METRICS_VERSION && header.count * sizeof(ChartMetrics) <= size - sizeof(header))
+        {
+            metrics.resize(header.count);
+            if (fread(metrics.data(), sizeof(ChartMetrics), header.count, file) != header.count)
+                metrics.clear();
+        }
+        fclose(file);
+    }
+
+    // Get the chart folder's modification time and file count to check if the index is up to date
+    struct stat st;
+    uint32_t mtime = (stat("/project-ds/dsc", &st) == 0) ? st.st_mtime : 0;
+    uint32_t files = mtime ? countFiles() : 0;
+
+    if (!loadIndex(mtime, files))
+    {
+        // Scan chart files (.dsc) and build song ID lists for each difficulty
+        if (DIR *dir = opendir("/project-ds/dsc"))
+        {
+            while (dirent *entry = readdir(dir))
+                addChart(entry->d_name);
+
+            closedir(dir);
+        }
+
+        // Save the results so the folder doesn't need to be scanned next time
+        if (mtime)
+            writeIndex(mtime, files);
+    }
+
+    // Add packed charts, which don't need to be indexed since they're listed in the pack
+    bool packed = false;
+    for (size_t i = 0; i < packCount(); i++)
+    {
+        std::string name = packName(i);
+        if (name.compare(0, 4, "dsc/") == 0)
+        {
+            addChart(name.substr(4));
+            packed = true;
+        }
+    }
+
+    // Remove charts that exist both in the pack and as loose files
+    for (int i = 0; packed && i < 5; i++)
+    {
+        std::sort(orders[0][i].begin(), orders[0][i].end());
+        orders[0][i].erase(std::unique(orders[0][i].begin(), orders[0][i].end()), orders[0][i].end());
+    }
 
     sortSongs();
+    selection = 0;
+
+    // Forget the audio status of every song, since the table may have changed
+    stopConversion();
+    convertQueue.clear();
+    audioStatus.assign(songData.size(), STATUS_UNKNOWN);
+
+    // Allocate list item text caches for the difficulty tabs that have songs
+    size_t bytes = metrics.capacity() * sizeof(ChartMetrics) + audioStatus.capacity();
+    for (int i = 0; i < 5; i++)
+    {
+        rowCache[i].assign(orders[0][i].empty() ? 0 : songData.size(), RowText());
+        bytes += rowCache[i].capacity() * sizeof(RowText);
+        for (int j = 0; j < SORT_COUNT; j++)
+            bytes += orders[j][i].capacity() * sizeof(uint16_t);
+    }
+    memoryTag(MEMORY_MENU, bytes);
+}
+
+void menuInit()
+{
+    menuLoaded = true;
+    loadLag();
+
+    // Build song ID lists for each difficulty from the chart index or chart files
+    loadCharts();
 
     // Allocate bitmap data for the menu objects
     menuGfx[0] = initObjBitmap(&oamSub, coolBitmap, coolBitmapLen, SpriteSize_32x8);
@@ -188,8 +756,95 @@ void menuInit()
     irqSet(IRQ_HBLANK, bgHBlank);
 }
 
+void menuResume(uint16_t id, size_t diff)
+{
+    // Defer the database and chart scans until a menu is needed after a restored session
+    resumeId = playingId = id;
+    difficulty = diff;
+
+    // Apply the lag for the song before it's resumed
+    loadLag();
+    applyLag(id);
+}
+
+static bool selectChart(uint16_t id, size_t diff)
+{
+    // Move the song list selection to a chart, leaving it alone if the chart isn't in the list
+    std::vector<uint16_t> &list = charts[diff];
+    auto it = std::find(list.begin(), list.end(), id);
+    if (it == list.end())
+        return false;
+    difficulty = diff;
+    selection = it - list.begin();
+    return true;
+}
+
+static bool dropMissing()
+{
+    // Drop charts from the front of the playlist that can't be found, returning true if any files were removed
+    bool removed = false;
+    while (!playlist.empty())
+    {
+        std::vector<uint16_t> &list = charts[playlist[0].difficulty];
+        bool exists = fileExists(songPath("dsc", playlist[0].id, ends[playlist[0].difficulty]));
+        if (exists && std::find(list.begin(), list.end(), playlist[0].id) != list.end())
+            break;
+        removed |= !exists;
+        playlist.erase(playlist.begin());
+    }
+    return removed;
+}
+
+static void menuReady()
+{
+    // Load the menu if it was skipped at boot
+    if (menuLoaded) return;
+    databaseInit();
+    menuInit();
+    bgHide(bg);
+    bgUpdate();
+
+    // Select the song that was resumed, or the top of the list if its chart is gone
+    if (!selectChart(resumeId, difficulty))
+        selection = 0;
+}
+
+static void playSelection()
+{
+    // Practice the whole chart by default
+    practiceA = practiceB = 0;
+
+    // Infer names for all the files that might need to be accessed
+    std::string dscName = songPath("dsc", charts[difficulty][selection], ends[difficulty]);
+    std::string oggName = songPath("ogg", charts[difficulty][selection], ".ogg");
+    std::string pcmName = songPath("pcm", charts[difficulty][selection], ".pcm");
+
+    // Try to convert the song if it wasn't found loose or in the pack, continuing any background progress
+    stopConversion();
+    bool retry = (!fileExists(pcmName) && convertSong(oggName, pcmName));
+
+    // Take the song out of the background queue if it was converted
+    auto it = std::find(convertQueue.begin(), convertQueue.end(), charts[difficulty][selection]);
+    if (retry && it != convertQueue.end())
+    {
+        audioStatus[findSong(*it) - &songData[0]] = STATUS_READY;
+        convertQueue.erase(it);
+        clearRow(charts[difficulty][selection]);
+    }
+
+    playingId = charts[difficulty][selection];
+    applyLag(playingId);
+    loadChart(dscName, pcmName, difficulty, retry);
+}
+
 void songList()
 {
+    menuReady();
+
+    // Free the lyrics of the previous song
+    freeLyrics();
+    memoryLog("menu");
+
     // Clear any sprites that were set
     oamClear(&oamSub, 0, 0);
     oamUpdate(&oamSub);
@@ -210,12 +865,13 @@ void songList()
     irqEnable(IRQ_HBLANK);
 
     uint8_t frames = 1;
+    bool redraw = true;
+    size_t drawnOffset = 0;
+    size_t drawnSelection = 0;
 
     // Show the file browser
     while (true)
     {
-        consoleClear();
-
         // Calculate the offset to display the files from
         size_t offset = 0;
         if (charts[difficulty].size() > 7)
@@ -240,42 +896,66 @@ void songList()
         BG_PALETTE_SUB[2] = pal[difficulty];
         bgLine = (selection - offset) * 8 * 3 + 3;
 
-        // Display a section of songs and their data around the current selection
-        for (size_t i = offset; i < offset + std::min(charts[difficulty].size(), 7U); i++)
+        if (redraw || offset != drawnOffset)
         {
-            SongData &data = songData[std::stoi(charts[difficulty][i])];
-            printf("\x1b[30m\x1b[%d;%dH%s", (i - offset) * 3 + 1, (i == selection), data.name.substr(0, 26).c_str());
-            printf("\x1b[%d;%dH%4.1f", (i - offset) * 3 + 1, 27 + (i == selection), ((float)((data.difficulty >> (difficulty * 5)) & 0x1F)) / 2);
-            printf("\x1b[%d;%dH%07lupt", (i - offset) * 3 + 2, 10 + (i == selection), data.scores[difficulty]);
-            printf("\x1b[%d;%dH%6.2f%%", (i - offset) * 3 + 2, 20 + (i == selection), data.clears[difficulty]);
-            static const char *ranks[5] = { "", "(S)", "(G)", "(E)", "(P)" };
-            printf("\x1b[%d;%dH%s", (i - offset) * 3 + 2, 28 + (i == selection), ranks[data.ranks[difficulty]]);
+            // Display a section of songs and their data around the current selection
+            if (redraw) consoleClear();
+            for (size_t i = offset; i < offset + std::min(charts[difficulty].size(), 7U); i++)
+                drawRow(i, offset);
+
+            // Display the difficulty tabs
+            if (redraw)
+            {
+                printf("\x1b[39m\x1b[23;0H%cEasy %cNormal %cHard %cExtrm %cExEx", a[difficulty == 0],
+                    a[difficulty == 1], a[difficulty == 2], a[difficulty == 3], a[difficulty == 4]);
+                if (getLatencyTest())
+                    printf("\x1b[22;0HLatency test on");
+                if (!playlist.empty())
+                    printf("\x1b[22;20HPlaylist %3u", playlist.size());
+            }
+        }
+        else if (selection != drawnSelection)
+        {
+            // Only redraw the items that were selected and deselected if the list didn't scroll
+            drawRow(drawnSelection, offset);
+            drawRow(selection, offset);
         }
 
-        // Display the difficulty tabs
-        printf("\x1b[39m\x1b[23;0H%cEasy %cNormal %cHard %cExtrm %cExEx", a[difficulty == 0],
-            a[difficulty == 1], a[difficulty == 2], a[difficulty == 3], a[difficulty == 4]);
+        redraw = false;
+        drawnOffset = offset;
+        drawnSelection = selection;
 
         uint16_t down = 0;
         uint16_t held = 0;
         keysDown();
 
         // Wait for button input
-        while (!(down & (KEY_A | KEY_Y | KEY_LEFT | KEY_RIGHT)) && !(held & (KEY_UP | KEY_DOWN)))
+        while (!(down & (KEY_A | KEY_X | KEY_Y | KEY_SELECT | KEY_START | KEY_L | KEY_R | KEY_LEFT | KEY_RIGHT)) &&
+            !(held & (KEY_UP | KEY_DOWN)))
         {
             scanKeys();
             down = keysDown();
             held = keysHeld();
 
             // On the first frame inputs are released, start playing a song preview
+            // Use the preview clip made by the converter, or the start of the full song if there isn't one
             if (!(held & (KEY_UP | KEY_DOWN)) && frames > 0)
             {
                 frames = 0;
-                std::string name = "/project-ds/pcm/pv_" + charts[difficulty][selection] + ".pcm";
-                playSong(name);
+                std::string name = songPath("pcm", charts[difficulty][selection], ".pre");
+                if (!playPreview(name))
+                {
+                    name = songPath("pcm", charts[difficulty][selection], ".pcm");
+                    playSong(name);
+                }
             }
 
             updateSong();
+
+            // Convert songs in the background while the list is idle
+            if (!held && frames == 0)
+                convertIdle(offset);
+
             swiWaitForVBlank();
         }
 
@@ -283,22 +963,99 @@ void songList()
 
         if (down & KEY_A)
         {
-            // Select the current song and close the menu
-            if (!charts[difficulty].empty())
+            // Rescan the chart files if the selected chart was removed after the index was written
+            if (!charts[difficulty].empty() &&
+                !fileExists(songPath("dsc", charts[difficulty][selection], ends[difficulty])))
+            {
+                remove("/project-ds/dsc.idx");
+                loadCharts();
+                redraw = true;
+            }
+            else if (!charts[difficulty].empty())
+            {
+                // Select the current song and close the menu
+                consoleClear();
+                bgHide(bg);
+                irqDisable(IRQ_HBLANK);
+                break;
+            }
+        }
+        else if (down & KEY_START)
+        {
+            // Rescan the chart files if queued charts were removed after the index was written
+            size_t queued = playlist.size();
+            if (dropMissing())
             {
+                remove("/project-ds/dsc.idx");
+                loadCharts();
+            }
+            else if (!playlist.empty() && selectChart(playlist[0].id, playlist[0].difficulty))
+            {
+                // Start playing the playlist from its first chart, closing the menu
+                playlist.erase(playlist.begin());
                 consoleClear();
                 bgHide(bg);
                 irqDisable(IRQ_HBLANK);
                 break;
             }
+
+            // Update the playlist count if any charts were dropped
+            if (playlist.size() != queued)
+                redraw = true;
+        }
+        else if (down & KEY_R)
+        {
+            // Add the current chart to the end of the playlist
+            if (frames++ == 0 && !charts[difficulty].empty() && playlist.size() < 999)
+            {
+                playlist.push_back({ charts[difficulty][selection], (uint16_t)difficulty });
+                redraw = true;
+            }
+        }
+        else if (down & KEY_L)
+        {
+            // Clear the playlist
+            if (frames++ == 0)
+            {
+                playlist.clear();
+                redraw = true;
+            }
         }
         else if (down & KEY_Y)
         {
-            // Change how the songs are sorted
+            // Change how the songs are sorted, only offering chart measurements if they were loaded
             if (frames++ == 0)
             {
-                sortSongs();
+                sortMode = (sortMode + 1) % (metrics.empty() ? SORT_DENSITY : SORT_COUNT);
+                charts = orders[sortMode];
                 selection = 0;
+                redraw = true;
+
+                // Clear the cached list item text, since the shown measurement depends on the sort
+                for (int i = 0; i < 5; i++)
+                    for (size_t j = 0; j < rowCache[i].size(); j++)
+                        rowCache[i][j].lines[0][0] = '\0';
+            }
+        }
+        else if (down & KEY_X)
+        {
+            // Show memory usage, hiding the list background while it's open
+            if (frames++ == 0)
+            {
+                bgHide(bg);
+                irqDisable(IRQ_HBLANK);
+                memoryScreen();
+                irqEnable(IRQ_HBLANK);
+                redraw = true;
+            }
+        }
+        else if (down & KEY_SELECT)
+        {
+            // Toggle measuring the hit sound latency during gameplay
+            if (frames++ == 0)
+            {
+                setLatencyTest(!getLatencyTest());
+                redraw = true;
             }
         }
         else if (down & KEY_LEFT)
@@ -307,6 +1064,7 @@ void songList()
             if (frames++ == 0)
             {
                 selection = 0;
+                redraw = true;
                 if (difficulty-- == 0)
                     difficulty = 4;
             }
@@ -317,6 +1075,7 @@ void songList()
             if (frames++ == 0)
             {
                 selection = 0;
+                redraw = true;
                 if (++difficulty == 5)
                     difficulty = 0;
             }
@@ -335,17 +1094,7 @@ void songList()
         }
     }
 
-    // Infer names for all the files that might need to be accessed
-    std::string dscName = "/project-ds/dsc/pv_" + charts[difficulty][selection] + ends[difficulty];
-    std::string oggName = "/project-ds/ogg/pv_" + charts[difficulty][selection] + ".ogg";
-    std::string pcmName = "/project-ds/pcm/pv_" + charts[difficulty][selection] + ".pcm";
-
-    // Try to convert the song if it wasn't found
-    FILE *song = fopen(pcmName.c_str(), "rb");
-    bool retry = (!song && convertSong(oggName, pcmName));
-    fclose(song);
-
-    loadChart(dscName, pcmName, difficulty, retry);
+    playSelection();
 }
 
 void retryMenu(bool pause)
@@ -353,15 +1102,31 @@ void retryMenu(bool pause)
     stopSong();
     uint32_t selection = !pause;
     uint8_t frames = 1;
+    bool relag = false;
+
+    // Keep the practice section within the current chart
+    size_t length = chartSeconds();
+    if (practiceB == 0 || practiceB > length)
+        practiceB = length;
+    if (practiceA >= practiceB)
+        practiceA = 0;
 
     while (true)
     {
         // Draw the menu items
-        if (pause) printf("\x1b[8;10H%cResume Game", a[selection == 0]);
-        printf("\x1b[10;13H%cRetry", a[selection == 1]);
-        printf("\x1b[12;10H%cLag Config", a[selection == 2]);
-        printf((selection == 2) ? "\x1b[12;22H<%05d>" : "\x1b[12;22H       ", lagConfigMs);
-        printf("\x1b[14;6H%cReturn to Song List", a[selection == 3]);
+        if (pause) printf("\x1b[6;10H%cResume Game", a[selection == 0]);
+        printf("\x1b[8;13H%cRetry", a[selection == 1]);
+        printf("\x1b[10;10H%cLag Config", a[selection == 2]);
+        printf((selection == 2) ? "\x1b[10;22H<%05d>" : "\x1b[10;22H       ", lagConfigMs);
+        printf("\x1b[12;9H%cSong Offset", a[selection == 3]);
+        printf((selection == 3) ? "\x1b[12;22H<%05d>" : "\x1b[12;22H       ", getSongLag(songId));
+        printf("\x1b[14;6H%cPractice from", a[selection == 4]);
+        printf((selection == 4) ? "\x1b[14;21H<%2u:%02u>" : "\x1b[14;21H %2u:%02u ", practiceA / 60, practiceA % 60);
+        printf("\x1b[16;6H%cPractice to", a[selection == 5]);
+        printf((selection == 5) ? "\x1b[16;21H<%2u:%02u>" : "\x1b[16;21H %2u:%02u ", practiceB / 60, practiceB % 60);
+        printf("\x1b[18;6H%cPractice speed", a[selection == 6]);
+        printf((selection == 6) ? "\x1b[18;21H< %3d%%>" : "\x1b[18;21H  %3d%% ", practiceSpeed);
+        printf("\x1b[20;6H%cReturn to Song List", a[selection == 7]);
 
         uint16_t down = 0;
         uint16_t held = 0;
@@ -380,17 +1145,38 @@ void retryMenu(bool pause)
 
         if (down & KEY_A)
         {
+            // Calibrate the lag config with a metronome
+            if (selection == 2)
+            {
+                relag |= calibrateLag();
+                continue;
+            }
+
+            // Save any lag changes before leaving the menu
+            if (lagChanged)
+                saveLag();
+
             // Handle the selected item
             switch (selection)
             {
                 case 0: // Resume Game
+                    // Reopen the song at the right position if the lag changed while paused
+                    if (relag)
+                        resyncSong();
                     resumeSong();
                     break;
 
-                case 2: // Lag Config
+                case 3: // Song Offset
                     continue;
 
-                case 3: // Return to Song List
+                case 4: // Practice from
+                case 5: // Practice to
+                case 6: // Practice speed
+                    consoleClear();
+                    startPractice(practiceA, practiceB, practiceSpeed);
+                    return;
+
+                case 7: // Return to Song List
                     songList();
                 case 1: // Retry
                     gameReset();
@@ -405,44 +1191,67 @@ void retryMenu(bool pause)
         {
             // Decrement the current selection with wraparound, continuously after 30 frames
             if ((frames > 30 || frames++ == 0) && selection-- == !pause)
-                selection = 3;
+                selection = 7;
         }
         else if (held & KEY_DOWN)
         {
             // Increment the current selection with wraparound, continuously after 30 frames
-            if ((frames > 30 || frames++ == 0) && ++selection == 4)
+            if ((frames > 30 || frames++ == 0) && ++selection == 8)
                 selection = !pause;
         }
-        else if (selection == 2 && (held & KEY_LEFT) && ((frames > 30 || frames++ == 0) && lagConfigMs > -1000))
+        else if (selection == 2 && (held & (KEY_LEFT | KEY_RIGHT)) && (frames > 30 || frames++ == 0))
         {
-            // Decrement the current lag config, continuously after 30 frames
-            setLagConfig(--lagConfigMs);
-
-            // Hide and disable the resume option if lag is adjusted
-            if (pause)
-            {
-                printf("\x1b[8;10H            ");
-                pause = false;
-            }
+            // Change the lag config by a millisecond, continuously after 30 frames
+            if ((held & KEY_LEFT) && lagConfigMs > -1000)
+                lagConfigMs--;
+            else if ((held & KEY_RIGHT) && lagConfigMs < 1000)
+                lagConfigMs++;
+            applyLag(songId);
+            lagChanged = relag = true;
         }
-        else if (selection == 2 && (held & KEY_RIGHT) && ((frames > 30 || frames++ == 0) && lagConfigMs < 1000))
+        else if (selection == 3 && (held & (KEY_LEFT | KEY_RIGHT)) && (frames > 30 || frames++ == 0))
         {
-            // Increment the current lag config, continuously after 30 frames
-            setLagConfig(++lagConfigMs);
-
-            // Hide and disable the resume option if lag is adjusted
-            if (pause)
-            {
-                printf("\x1b[8;10H            ");
-                pause = false;
-            }
+            // Change the current song's offset by a millisecond, continuously after 30 frames
+            int ms = getSongLag(songId);
+            if ((held & KEY_LEFT) && ms > -1000)
+                setSongLag(songId, ms - 1);
+            else if ((held & KEY_RIGHT) && ms < 1000)
+                setSongLag(songId, ms + 1);
+            applyLag(songId);
+            lagChanged = relag = true;
+        }
+        else if (selection == 4 && (held & (KEY_LEFT | KEY_RIGHT)) && (frames > 30 || frames++ == 0))
+        {
+            // Move the start of the practice section by a second, keeping it before the end
+            if ((held & KEY_LEFT) && practiceA > 0)
+                practiceA--;
+            else if ((held & KEY_RIGHT) && practiceA + 1 < practiceB)
+                practiceA++;
+        }
+        else if (selection == 5 && (held & (KEY_LEFT | KEY_RIGHT)) && (frames > 30 || frames++ == 0))
+        {
+            // Move the end of the practice section by a second, keeping it after the start
+            if ((held & KEY_LEFT) && practiceB > practiceA + 1)
+                practiceB--;
+            else if ((held & KEY_RIGHT) && practiceB < length)
+                practiceB++;
+        }
+        else if (selection == 6 && (held & (KEY_LEFT | KEY_RIGHT)) && frames++ == 0)
+        {
+            // Change the practice speed in 10% steps, from half to full speed
+            if ((held & KEY_LEFT) && practiceSpeed > 50)
+                practiceSpeed -= 10;
+            else if ((held & KEY_RIGHT) && practiceSpeed < 100)
+                practiceSpeed += 10;
         }
     }
 }
 
 void resultsScreen(Results *results, bool fail)
 {
+    menuReady();
     stopSong();
+    memoryLog("results");
 
     // Clear the bottom screen
     oamClear(&oamSub, 0, 0);
@@ -458,9 +1267,13 @@ void resultsScreen(Results *results, bool fail)
         "EX EXTREME"
     };
 
-    // Show the difficulty and song name at the top
-    SongData &data = songData[std::stoi(charts[difficulty][selection])];
-    printf("\x1b[0;0H%s - %s", diffs[difficulty].c_str(), data.name.substr(0, 29 - diffs[difficulty].length()).c_str());
+    // Show the difficulty and song name at the top, using the ID of the song that was played
+    // The selection can't be trusted here, since a resumed chart may be missing from the rebuilt list
+    SongData *data = findSong(playingId);
+    if (data)
+        printf("\x1b[0;0H%s - %.*s", diffs[difficulty].c_str(), (int)(29 - diffs[difficulty].length()), getSongName(*data));
+    else
+        printf("\x1b[0;0H%s", diffs[difficulty].c_str());
 
     static uint8_t percents[5][3] =
     {
@@ -513,11 +1326,11 @@ void resultsScreen(Results *results, bool fail)
     oamUpdate(&oamSub);
 
     // Show statistics from the results
-    printf("\x1b[9;6H%12lu/%6.02f%%",  results->cools,  100.0f * results->cools  / results->total);
-    printf("\x1b[10;6H%12lu/%6.02f%%", results->fines,  100.0f * results->fines  / results->total);
-    printf("\x1b[11;6H%12lu/%6.02f%%", results->safes,  100.0f * results->safes  / results->total);
-    printf("\x1b[12;6H%12lu/%6.02f%%", results->sads,   100.0f * results->sads   / results->total);
-    printf("\x1b[13;6H%12lu/%6.02f%%", results->misses, 100.0f * results->misses / results->total);
+    for (int i = 0; i < JUDGE_COUNT; i++)
+    {
+        printf("\x1b[%d;6H%12lu/%6.02f%%", 9 + i, results->judgements[i],
+            100.0f * results->judgements[i] / results->total);
+    }
     printf("\x1b[14;6HCOMBO %13lu", results->comboMax);
     printf("\x1b[15;6HHOLD  %13lu", results->scoreHold);
     printf("\x1b[16;6HSLIDE %13lu", results->scoreSlide);
@@ -526,16 +1339,36 @@ void resultsScreen(Results *results, bool fail)
     uint32_t score = results->scoreBase + results->scoreHold + results->scoreSlide;
     printf("\x1b[18;6HSCORE %13lu", score);
 
-    // Update the saved scores if any records were broken
+    // Show how many frames were skipped to keep the chart in sync, if any
+    if (results->skipped)
+        printf("\x1b[20;6HSKIPPED FRAMES %4lu", results->skipped);
+
+    // Update the saved scores if any records were broken, skipping songs that are no longer in the database
     bool update = false;
-    if (score > data.scores[difficulty])
-        update = true, data.scores[difficulty] = score;
-    if (results->clear > data.clears[difficulty])
-        update = true, data.clears[difficulty] = results->clear;
-    if (rank > data.ranks[difficulty])
-        update = true, data.ranks[difficulty] = rank;
+    if (data && score > data->scores[difficulty])
+        update = true, data->scores[difficulty] = score;
+    if (data && results->clear > data->clears[difficulty])
+        update = true, data->clears[difficulty] = results->clear;
+    if (data && rank > data->ranks[difficulty])
+        update = true, data->ranks[difficulty] = rank;
     if (update)
-        writeScores();
+    {
+        writeScore(*data, difficulty);
+        size_t index = data - &songData[0];
+        if (index < rowCache[difficulty].size())
+            rowCache[difficulty][index].lines[0][0] = '\0';
+    }
+
+    // Load the next chart in the playlist while the results are shown, so it can start as soon as A is pressed
+    // Skip any that can't be found; the song list rescans the chart files the next time one is selected
+    dropMissing();
+    if (!playlist.empty())
+    {
+        printf("\x1b[21;6HA: NEXT SONG (%u LEFT)", playlist.size());
+        std::string dscName = songPath("dsc", playlist[0].id, ends[playlist[0].difficulty]);
+        std::string pcmName = songPath("pcm", playlist[0].id, ".pcm");
+        prefetchChart(dscName, pcmName, lagConfigMs + getSongLag(playlist[0].id));
+    }
 
     uint16_t down = 0;
     keysDown();
@@ -548,9 +1381,17 @@ void resultsScreen(Results *results, bool fail)
         swiWaitForVBlank();
     }
 
-    // When A is pressed, clear the screen and show the retry menu
+    // When A is pressed, clear the screen and play the next chart in the playlist, or show the retry menu
     oamClear(&oamSub, 0, 0);
     oamUpdate(&oamSub);
     consoleClear();
-    retryMenu();
+    if (!playlist.empty() && selectChart(playlist[0].id, playlist[0].difficulty))
+    {
+        playlist.erase(playlist.begin());
+        playSelection();
+    }
+    else
+    {
+        retryMenu();
+    }
 }
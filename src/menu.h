@@ -20,9 +20,13 @@
 #ifndef MENU_H
 #define MENU_H
 
+#include <cstddef>
+#include <cstdint>
+
 struct Results;
 
 extern void menuInit();
+extern void menuResume(uint16_t id, size_t diff);
 
 extern void songList();
 extern void retryMenu(bool pause = false);
@@ -0,0 +1,162 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#include <nds.h>
+
+#include "debug.h"
+#include "pack.h"
+
+#define PACK_PATH "/project-ds/data.pak"
+#define PACK_ROOT "/project-ds/"
+
+static PackEntry *entries = nullptr;
+static char *names = nullptr;
+static uint32_t count = 0;
+static uint32_t mtime = 0;
+
+static bool validEntries(uint32_t namesSize, uint32_t packSize)
+{
+    // Check that every entry's name and data lie within the pack, and that the names are sorted for searching
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (entries[i].name >= namesSize || entries[i].offset > packSize || entries[i].size > packSize - entries[i].offset)
+            return false;
+        if (i > 0 && strcmp(&names[entries[i - 1].name], &names[entries[i].name]) >= 0)
+            return false;
+    }
+    return true;
+}
+
+void packInit()
+{
+    // Load the table of contents from the pack if there is one
+    FILE *file = fopen(PACK_PATH, "rb");
+    if (!file) return;
+    fseek(file, 0, SEEK_END);
+    uint32_t packSize = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    PackHeader header;
+
+    // Make sure the table fits in the pack before allocating it, in case the header is corrupt
+    if (fread(&header, sizeof(header), 1, file) == 1 && header.magic == PACK_MAGIC &&
+        header.count <= (packSize - sizeof(header)) / sizeof(PackEntry) &&
+        header.namesSize <= packSize - sizeof(header) - header.count * sizeof(PackEntry))
+    {
+        entries = new PackEntry[header.count];
+        names = new char[header.namesSize + 1];
+        names[header.namesSize] = '\0';
+
+        // Only use the table if it was read in full and every entry is valid
+        if (fread(entries, sizeof(PackEntry), header.count, file) == header.count &&
+            fread(names, sizeof(char), header.namesSize, file) == header.namesSize)
+        {
+            count = header.count;
+        }
+        if (!validEntries(header.namesSize, packSize))
+            count = 0;
+        if (!count)
+        {
+            delete[] entries;
+            delete[] names;
+            entries = nullptr;
+            names = nullptr;
+        }
+    }
+
+    fclose(file);
+    if (count)
+        memoryTag(MEMORY_PACK, count * sizeof(PackEntry) + header.namesSize + 1);
+
+    // Remember when the pack was written so caches built from it can be validated
+    struct stat st;
+    if (count && stat(PACK_PATH, &st) == 0)
+        mtime = st.st_mtime;
+}
+
+size_t packCount()
+{
+    return count;
+}
+
+const char *packName(size_t index)
+{
+    return &names[entries[index].name];
+}
+
+uint32_t packSize(size_t index)
+{
+    return entries[index].size;
+}
+
+uint32_t packTime()
+{
+    return mtime;
+}
+
+static PackEntry *findEntry(const std::string &path)
+{
+    // Only files in the project folder can be packed
+    size_t root = strlen(PACK_ROOT);
+    if (!count || path.compare(0, root, PACK_ROOT) != 0)
+        return nullptr;
+
+    // Binary search the sorted table for the path relative to the project folder
+    const char *name = path.c_str() + root;
+    PackEntry *entry = std::lower_bound(entries, entries + count, name,
+        [](const PackEntry &e, const char *n) { return strcmp(&names[e.name], n) < 0; });
+    return (entry != entries + count && !strcmp(&names[entry->name], name)) ? entry : nullptr;
+}
+
+FILE *openFile(const std::string &path, uint32_t &base, uint32_t &size)
+{
+    // Open the pack at the start of a file's data if it's packed
+    if (PackEntry *entry = findEntry(path))
+    {
+        FILE *file = fopen(PACK_PATH, "rb");
+        if (!file) return nullptr;
+        if (entry->offset > 0x7FFFFFFF || fseek(file, entry->offset, SEEK_SET) != 0)
+        {
+            fclose(file);
+            return nullptr;
+        }
+        base = entry->offset;
+        size = entry->size;
+        return file;
+    }
+
+    // Fall back to opening the loose file
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) return nullptr;
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    base = 0;
+    return file;
+}
+
+bool fileExists(const std::string &path)
+{
+    // Check the pack first, then the loose files
+    struct stat st;
+    return findEntry(path) || stat(path.c_str(), &st) == 0;
+}
@@ -0,0 +1,56 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PACK_H
+#define PACK_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#define PACK_MAGIC 0x4B504450 // "PDPK"
+#define PACK_ALIGN 512
+
+// Header at the start of data.pak, followed by the entries and then their names
+struct PackHeader
+{
+    uint32_t magic;
+    uint32_t count;
+    uint32_t namesSize;
+};
+
+// Table entry for a packed file, sorted by name and aligned to a sector
+struct PackEntry
+{
+    uint32_t name;
+    uint32_t offset;
+    uint32_t size;
+};
+
+extern void packInit();
+extern size_t packCount();
+extern const char *packName(size_t index);
+extern uint32_t packSize(size_t index);
+extern uint32_t packTime();
+
+extern FILE *openFile(const std::string &path, uint32_t &base, uint32_t &size);
+extern bool fileExists(const std::string &path);
+
+#endif // PACK_H
@@ -0,0 +1,122 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstdio>
+
+#include "../src/chart.h"
+
+static int failures = 0;
+
+static void check(bool condition, const char *name)
+{
+    // Report a failed check without stopping, so one run shows everything that's wrong
+    if (!condition)
+    {
+        printf("FAIL: %s\n", name);
+        failures++;
+    }
+}
+
+static std::vector<uint32_t> makeChart(uint32_t signature)
+{
+    // Build a short Future Tone chart with a flying time, a note, a lyric, and the music starting
+    return
+    {
+        signature,
+        0x1C, 150, 3,
+        0x01, 100000,
+        0x19,
+        0x18, 1, 0xFFFFFFFF,
+        0x06, 1, 240000, 135000, 90000, 1000000, 0, 0,
+        0x01, 200000,
+        0x00
+    };
+}
+
+static std::vector<uint32_t> swapChart(std::vector<uint32_t> chart)
+{
+    // Store a chart's words big-endian, like the PS3 releases do
+    for (size_t i = 0; i < chart.size(); i++)
+        chart[i] = __builtin_bswap32(chart[i]);
+    return chart;
+}
+
+int main()
+{
+    // Compile a Future Tone chart and check the events it produces
+    std::vector<uint32_t> ft = makeChart(0x14050921);
+    std::vector<ChartEvent> events;
+    check(detectChart(ft.data(), ft.size()) == FORMAT_FT, "FT detected");
+    check(compileChart(ft.data(), ft.size(), events), "FT compiled");
+    check(events.size() == 7, "FT event count");
+    if (events.size() == 7)
+    {
+        check(events[0].event == EVENT_FLYTIME && events[0].value == barFlyTime(150, 3), "FT flying time");
+        check(events[1].event == EVENT_TIME && events[1].value == 100000, "FT time");
+        check(events[2].event == EVENT_MUSIC, "FT music");
+        check(events[3].event == EVENT_LYRIC && events[3].value == 1, "FT lyric");
+        check(events[4].event == EVENT_NOTE && events[4].type == 1, "FT note type");
+        check(events[4].x == 128 - 16 && events[4].y == 96 - 16, "FT note position");
+        check(events[4].incX > 0 && events[4].incY == 0, "FT note direction");
+        check(events[6].event == EVENT_END, "FT end");
+    }
+
+    // Charts with an unrecognised first word should still compile as Future Tone, as they did before detection
+    std::vector<ChartEvent> other;
+    std::vector<uint32_t> custom = makeChart(0x1234ABCD);
+    check(detectChart(custom.data(), custom.size()) == FORMAT_FT, "non-date signature detected as FT");
+    check(compileChart(custom.data(), custom.size(), other) && other.size() == events.size(),
+        "non-date signature compiled as FT");
+    custom = makeChart(0);
+    check(compileChart(custom.data(), custom.size(), other) && other.size() == events.size(),
+        "zero signature compiled as FT");
+
+    // Unknown opcodes are skipped rather than ending the chart
+    custom = ft;
+    custom.insert(custom.begin() + 1, 0x80);
+    check(compileChart(custom.data(), custom.size(), other) && other.size() == events.size(), "unknown opcode skipped");
+
+    // Recognised formats without a known opcode table should be rejected cleanly instead of misread
+    std::vector<uint32_t> pvsc = { 0x43535650, 0, 0x40, 0 };
+    pvsc.resize(0x10);
+    std::vector<uint32_t> script = makeChart(0x13120420);
+    pvsc.insert(pvsc.end(), script.begin(), script.end());
+    check(detectChart(pvsc.data(), pvsc.size()) == FORMAT_PVSC, "PVSC detected");
+    check(!compileChart(pvsc.data(), pvsc.size(), other) && other.empty(), "PVSC rejected");
+    std::vector<uint32_t> be = swapChart(ft);
+    check(detectChart(be.data(), be.size()) == FORMAT_BE, "big-endian detected");
+    check(!compileChart(be.data(), be.size(), other) && other.empty(), "big-endian rejected");
+    check(!compileChart(ft.data(), 1, other) && other.empty(), "signature alone rejected");
+
+    // Measure the chart the way the song list does
+    ChartMetrics metrics;
+    measureChart(events, metrics);
+    check(metrics.notes == 1 && metrics.peakDensity == 1, "metrics note count");
+    check(metrics.minFlyTime == barFlyTime(150, 3) && metrics.maxFlyTime == barFlyTime(150, 3), "metrics flying time");
+
+    // Check the CRC against a known value, since the converter and the game both rely on it
+    const uint32_t words[] = { 0x11111111, 0x22222222 };
+    check(chartCrc(words, 2) == 0x434C, "chart CRC");
+
+    if (failures)
+        return 1;
+    printf("All chart tests passed.\n");
+    return 0;
+}
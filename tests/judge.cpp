@@ -0,0 +1,118 @@
+/*
+    Copyright 2022-2024 Hydr8gon
+
+    This file is part of Project DS.
+
+    Project DS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published
+    by the Free Software Foundation, either version 3 of the License,
+    or (at your option) any later version.
+
+    Project DS is distributed in the hope that it will be useful, but
+    WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+    General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with Project DS. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "../src/judge.h"
+
+// The branching judgement from before the tables, kept as the reference they have to match
+static JudgeRecord referenceHit(uint8_t type, uint32_t offset)
+{
+    if (type & (1 << 7)) // Held slide
+        return { JUDGE_COOL, 0, 500 };
+    if (offset <= FRAME_TIME * ((type & 0xE0) ? 9 : 3)) // Cool
+        return { JUDGE_COOL, 2, 500 };
+    if (offset <= FRAME_TIME * 6 || (type & 0xE0)) // Fine
+        return { JUDGE_FINE, 1, 300 };
+    if (offset <= FRAME_TIME * 9) // Safe
+        return { JUDGE_SAFE, 0, 100 };
+    return { JUDGE_SAD, -10, 50 }; // Sad
+}
+
+static JudgeRecord referenceWrong(uint8_t type, uint32_t offset)
+{
+    if (offset <= FRAME_TIME * ((type & 0xE0) ? 9 : 3)) // Wrong (red)
+        return { JUDGE_MISS, -3, 250 };
+    if (offset <= FRAME_TIME * 6 || (type & 0xE0)) // Wrong (black)
+        return { JUDGE_MISS, -6, 150 };
+    if (offset <= FRAME_TIME * 9) // Wrong (green)
+        return { JUDGE_MISS, -9, 50 };
+    return { JUDGE_MISS, -15, 30 }; // Wrong (blue)
+}
+
+static bool sameRecord(const JudgeRecord &a, const JudgeRecord &b)
+{
+    return a.judgement == b.judgement && a.life == b.life && a.score == b.score;
+}
+
+int main()
+{
+    int failures = 0;
+
+    // Compare every note type at every offset up to well past the last window
+    for (int type = 0; type < 0x100; type++)
+    {
+        for (uint32_t offset = 0; offset <= FRAME_TIME * 12; offset++)
+        {
+            if (!sameRecord(judgeHits[noteClass(type)](offset), referenceHit(type, offset)))
+            {
+                if (failures++ < 10)
+                    printf("FAIL: hit on type 0x%02X at offset %u\n", type, offset);
+            }
+
+            // Wrong keys on held slides aren't judged, since those only need to be held
+            if (!(type & (1 << 7)) && !sameRecord(judgeWrongs[noteClass(type)](offset), referenceWrong(type, offset)))
+            {
+                if (failures++ < 10)
+                    printf("FAIL: wrong key on type 0x%02X at offset %u\n", type, offset);
+            }
+        }
+    }
+
+    if (failures)
+    {
+        printf("%d judgements differ from the reference.\n", failures);
+        return 1;
+    }
+    printf("All judge tests passed.\n");
+
+    // Benchmark both versions over the same pseudo-random notes, as a rough guide for the DS
+    const size_t count = 1 << 20;
+    std::vector<uint8_t> types(count);
+    std::vector<uint32_t> offsets(count);
+    uint32_t seed = 1;
+    for (size_t i = 0; i < count; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        types[i] = (seed >> 8) & 0x7F;
+        offsets[i] = (seed >> 12) % (FRAME_TIME * 12);
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        uint32_t total = 0;
+        for (int repeat = 0; repeat < 16; repeat++)
+        {
+            for (size_t i = 0; i < count; i++)
+            {
+                JudgeRecord record = pass ? judgeHits[noteClass(types[i])](offsets[i]) :
+                    referenceHit(types[i], offsets[i]);
+                total += record.score + record.judgement;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        double ns = std::chrono::duration<double, std::nano>(end - start).count() / (count * 16);
+        printf("%-9s %.2fns per judgement (checksum %u)\n", pass ? "Tables:" : "Branches:", ns, total);
+    }
+    return 0;
+}